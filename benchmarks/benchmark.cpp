@@ -0,0 +1,504 @@
+// Standard library.
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <filesystem>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <numbers>
+#include <cmath>
+#include <tuple>
+#include <cstdlib>
+
+// Third party.
+#include "geometric_primitives.hxx"
+#include "toolpath.hxx"
+
+using namespace std;
+
+/*
+   ****************************************************************************
+                                  Workloads
+   ****************************************************************************
+*/
+
+// Every workload is swept by this tool and meshed with these parameters, so
+//     timings are comparable between workloads.
+const CylindricalTool benchmark_tool {.2, 1.5};
+const pair<double, double> benchmark_mesh_options {.5, .001};
+
+// Distance between neighbouring passes. Smaller than the tool diameter, so
+//     neighbouring sweeps overlap like they do in real pockets.
+const double stepover {.3};
+
+/*
+    Back and forth passes over a rectangular pocket, joined by short moves
+        across. Only lines.
+
+    Arguments:
+        segments: Approximate number of segments to generate.
+*/
+SegmentCompound zigzag_pocket(const size_t segments)
+{
+    const double width {5};
+    const size_t passes {max<size_t>(1, (segments + 1) / 2)};
+
+    vector<Line> lines;
+    for (size_t i {0}; i < passes; ++i)
+    {
+        const double y {i * stepover};
+        const bool forward {i % 2 == 0};
+        lines.emplace_back(Point3D {forward ? 0 : width, y, 0}, Vec3D {forward ? width : -width, 0, 0});
+        if (i + 1 < passes)
+            lines.emplace_back(Point3D {forward ? width : 0, y, 0}, Vec3D {0, stepover, 0});
+    }
+
+    return {lines, {}, {}, {}};
+}
+
+/*
+    An Archimedean spiral from the center of a pocket outwards. Each eighth of
+        a turn is an arc through three points of the spiral.
+
+    Arguments:
+        segments: Number of arcs to generate.
+*/
+SegmentCompound spiral(const size_t segments)
+{
+    const double start_radius {.5};
+    const double step {numbers::pi / 4};
+    const auto point = [=](const double theta) -> Point3D
+    {
+        const double r {start_radius + stepover * theta / (2 * numbers::pi)};
+        return {r * cos(theta), r * sin(theta), 0};
+    };
+
+    vector<ArcOfCircle> arcs;
+    for (size_t i {0}; i < segments; ++i)
+    {
+        const double theta {i * step};
+        arcs.emplace_back(pair {point(theta), point(theta + step)}, point(theta + step / 2));
+    }
+
+    return {{}, arcs, {}, {}};
+}
+
+/*
+    A slot cut by looping the tool along a circle while its center advances,
+        i.e. a trochoid. Each quarter loop is an arc through three points of
+        the trochoid.
+
+    Arguments:
+        segments: Number of arcs to generate.
+*/
+SegmentCompound trochoidal_slot(const size_t segments)
+{
+    const double loop_radius {.5};
+    const double advance_per_loop {.15};
+    const double step {numbers::pi / 2};
+    const auto point = [=](const double t) -> Point3D
+    {
+        return {advance_per_loop * t / (2 * numbers::pi) + loop_radius * cos(t), loop_radius * sin(t), 0};
+    };
+
+    vector<ArcOfCircle> arcs;
+    for (size_t i {0}; i < segments; ++i)
+    {
+        const double t {i * step};
+        arcs.emplace_back(pair {point(t), point(t + step)}, point(t + step / 2));
+    }
+
+    return {{}, arcs, {}, {}};
+}
+
+/*
+    A square grid of holes. A plunge along the tool axis sweeps nothing that
+        the toolpath can represent, so every hole is bored by moving the tool
+        around a small circle instead. The holes don't touch each other.
+
+    Arguments:
+        segments: Approximate number of holes to generate.
+*/
+SegmentCompound drilling_grid(const size_t segments)
+{
+    const double bore_radius {.25};
+    const double pitch {1};
+    const size_t side {max<size_t>(1, static_cast<size_t>(ceil(sqrt(static_cast<double>(segments)))))};
+
+    vector<Circle> circles;
+    for (size_t i {0}; i < side; ++i)
+        for (size_t j {0}; j < side; ++j)
+        {
+            const double x {i * pitch};
+            const double y {j * pitch};
+            circles.emplace_back(Point3D {x + bore_radius, y, 0},
+                                 Point3D {x, y + bore_radius, 0},
+                                 Point3D {x - bore_radius, y, 0});
+        }
+
+    return {{}, {}, {}, circles};
+}
+
+/*
+    A chain of tangent-continuous arcs with random radii, sweeps and turning
+        directions. The sequence only depends on the number of segments, so
+        every run benchmarks the same path.
+
+    Arguments:
+        segments: Number of arcs to generate.
+*/
+SegmentCompound random_arcs(const size_t segments)
+{
+    mt19937_64 generator {segments};
+    uniform_real_distribution<double> radius_distribution {.5, 2};
+    uniform_real_distribution<double> sweep_distribution {numbers::pi / 6, 2 * numbers::pi / 3};
+    bernoulli_distribution turn_left {.5};
+
+    Point3D start {0, 0, 0};
+    double heading {0};
+
+    vector<ArcOfCircle> arcs;
+    for (size_t i {0}; i < segments; ++i)
+    {
+        const double radius {radius_distribution(generator)};
+        const double sweep {sweep_distribution(generator)};
+        // The center lies on the left of the heading for counterclockwise
+        //     arcs, and on the right for clockwise arcs.
+        const double side {turn_left(generator) ? 1.0 : -1.0};
+        const double center_x {start[0] - side * radius * sin(heading)};
+        const double center_y {start[1] + side * radius * cos(heading)};
+        const double start_angle {heading - side * numbers::pi / 2};
+        const auto point = [&](const double angle) -> Point3D
+        {
+            return {center_x + radius * cos(angle), center_y + radius * sin(angle), 0};
+        };
+
+        const Point3D end {point(start_angle + side * sweep)};
+        arcs.emplace_back(pair {start, end}, point(start_angle + side * sweep / 2));
+
+        start = end;
+        heading += side * sweep;
+    }
+
+    return {{}, arcs, {}, {}};
+}
+
+struct Workload
+{
+    const string name;
+    const function<SegmentCompound(size_t)> generate;
+    // Segment counts at a scale of one.
+    const vector<size_t> sizes;
+};
+
+const vector<Workload> workloads
+{
+    {"zigzag pocket", zigzag_pocket, {16, 64}},
+    {"spiral", spiral, {16, 64}},
+    {"trochoidal slot", trochoidal_slot, {16, 64}},
+    {"drilling grid", drilling_grid, {16, 64}},
+    {"random arcs", random_arcs, {16, 64}}
+};
+
+// Every workload is built once with each of these option sets.
+const vector<pair<string, BuildOptions>> option_sets
+{
+    {"reference", {}},
+    {
+        "fast",
+        {
+            .union_mode = UnionMode::tree_reduction,
+            .cluster_disjoint = true,
+            .shared_caps = true,
+            .analytic_lines = true,
+            .analytic_arcs = true
+        }
+    }
+};
+
+/*
+   ****************************************************************************
+                            File Local Declarations
+   ****************************************************************************
+*/
+
+struct Settings
+{
+    string output;
+    size_t repetitions {1};
+    double scale {1};
+    // Only workloads whose name contains this are run.
+    string filter;
+    filesystem::path scratch_directory {filesystem::temp_directory_path()};
+};
+
+// The wall times of one stage, in seconds, one per repetition.
+typedef vector<double> StageTimes;
+
+struct Result
+{
+    string workload;
+    size_t requested_segments;
+    size_t segments;
+    string option_set;
+    StageTimes construct {};
+    StageTimes mesh_surface {};
+    StageTimes ascii_stl {};
+    StageTimes binary_stl {};
+    uintmax_t ascii_stl_bytes {0};
+    uintmax_t binary_stl_bytes {0};
+};
+
+bool parse_settings(const int argc, char** argv, Settings& settings);
+
+size_t segment_count(const SegmentCompound& compound);
+
+double seconds_since(const chrono::steady_clock::time_point start);
+
+Result run_case(const Workload& workload,
+                const size_t segments,
+                const pair<string, BuildOptions>& option_set,
+                const Settings& settings);
+
+string json_string(const string& s);
+
+void write_stage(ostream& out, const string& name, const StageTimes& times);
+
+void write_results(ostream& out, const vector<Result>& results, const Settings& settings);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                            File Local Definitions
+   ****************************************************************************
+*/
+
+/*
+    Reads the command line. Prints the usage and fails on anything unknown.
+*/
+bool parse_settings(const int argc, char** argv, Settings& settings)
+{
+    for (int i {1}; i < argc; ++i)
+    {
+        const string arg {argv[i]};
+        const bool has_value {i + 1 < argc};
+        if (arg == "--output" and has_value)
+            settings.output = argv[++i];
+        else if (arg == "--repetitions" and has_value)
+            settings.repetitions = max<size_t>(1, stoul(argv[++i]));
+        else if (arg == "--scale" and has_value)
+            settings.scale = stod(argv[++i]);
+        else if (arg == "--filter" and has_value)
+            settings.filter = argv[++i];
+        else if (arg == "--scratch" and has_value)
+            settings.scratch_directory = argv[++i];
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--output FILE] [--repetitions N] [--scale X] [--filter NAME] [--scratch DIRECTORY]" << endl;
+            cerr << "    Results are written as JSON to FILE, or to the standard output." << endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t segment_count(const SegmentCompound& compound)
+{
+    return get<0>(compound).size() + get<1>(compound).size() + get<2>(compound).size() + get<3>(compound).size();
+}
+
+double seconds_since(const chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+    Builds, meshes and writes one workload with one option set, as many times
+        as requested, timing every stage separately. The .stl files go to the
+        scratch directory and are removed afterwards.
+*/
+Result run_case(const Workload& workload,
+                const size_t segments,
+                const pair<string, BuildOptions>& option_set,
+                const Settings& settings)
+{
+    const SegmentCompound compound {workload.generate(segments)};
+    Result result {.workload = workload.name,
+                   .requested_segments = segments,
+                   .segments = segment_count(compound),
+                   .option_set = option_set.first};
+
+    string file_name {"surfacic_toolpaths_benchmark_" + workload.name + "_" + option_set.first};
+    replace(file_name.begin(), file_name.end(), ' ', '_');
+    const filesystem::path ascii_path {settings.scratch_directory / (file_name + ".stl")};
+    const filesystem::path binary_path {settings.scratch_directory / (file_name + ".binary.stl")};
+
+    for (size_t i {0}; i < settings.repetitions; ++i)
+    {
+        auto start {chrono::steady_clock::now()};
+        ToolPath tool_path {compound, benchmark_tool, false, option_set.second};
+        result.construct.push_back(seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        tool_path.mesh_surface(benchmark_mesh_options.first, benchmark_mesh_options.second);
+        result.mesh_surface.push_back(seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        tool_path.shape_to_stl(workload.name, ascii_path.string(), StlFormat::ascii);
+        result.ascii_stl.push_back(seconds_since(start));
+
+        start = chrono::steady_clock::now();
+        tool_path.shape_to_stl(workload.name, binary_path.string(), StlFormat::binary);
+        result.binary_stl.push_back(seconds_since(start));
+    }
+
+    result.ascii_stl_bytes = filesystem::file_size(ascii_path);
+    result.binary_stl_bytes = filesystem::file_size(binary_path);
+    filesystem::remove(ascii_path);
+    filesystem::remove(binary_path);
+
+    return result;
+}
+
+/*
+    Quotes a string for JSON. Workload and option set names are plain text, so
+        only quotes and backslashes need escaping.
+*/
+string json_string(const string& s)
+{
+    string quoted {"\""};
+    for (const char c : s)
+    {
+        if (c == '"' or c == '\\')
+            quoted += '\\';
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+void write_stage(ostream& out, const string& name, const StageTimes& times)
+{
+    StageTimes sorted {times};
+    sort(sorted.begin(), sorted.end());
+
+    out << "        " << json_string(name) << ": {\"min\": " << sorted.front()
+        << ", \"median\": " << sorted[sorted.size() / 2]
+        << ", \"max\": " << sorted.back() << ", \"samples\": [";
+    for (size_t i {0}; i < times.size(); ++i)
+        out << (i == 0 ? "" : ", ") << times[i];
+    out << "]}";
+}
+
+/*
+    Writes the results and what they were measured with as a single JSON
+        object, so runs of different releases and builds can be compared.
+*/
+void write_results(ostream& out, const vector<Result>& results, const Settings& settings)
+{
+#ifdef NDEBUG
+    const bool assertions {false};
+#else
+    const bool assertions {true};
+#endif
+#ifdef __OPTIMIZE__
+    const bool optimized {true};
+#else
+    const bool optimized {false};
+#endif
+#ifdef __VERSION__
+    const string compiler {__VERSION__};
+#else
+    const string compiler {"unknown"};
+#endif
+
+    out.precision(9);
+    out << "{\n";
+    out << "  \"build\": {\"compiler\": " << json_string(compiler)
+        << ", \"optimized\": " << (optimized ? "true" : "false")
+        << ", \"assertions\": " << (assertions ? "true" : "false") << "},\n";
+    out << "  \"hardware_threads\": " << thread::hardware_concurrency() << ",\n";
+    out << "  \"repetitions\": " << settings.repetitions << ",\n";
+    out << "  \"scale\": " << settings.scale << ",\n";
+    out << "  \"results\": [";
+    for (size_t i {0}; i < results.size(); ++i)
+    {
+        const Result& result {results[i]};
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"workload\": " << json_string(result.workload) << ",\n";
+        out << "      \"requested_segments\": " << result.requested_segments << ",\n";
+        out << "      \"segments\": " << result.segments << ",\n";
+        out << "      \"options\": " << json_string(result.option_set) << ",\n";
+        out << "      \"ascii_stl_bytes\": " << result.ascii_stl_bytes << ",\n";
+        out << "      \"binary_stl_bytes\": " << result.binary_stl_bytes << ",\n";
+        out << "      \"seconds\": {\n";
+        write_stage(out, "construct", result.construct);
+        out << ",\n";
+        write_stage(out, "mesh_surface", result.mesh_surface);
+        out << ",\n";
+        write_stage(out, "shape_to_stl ascii", result.ascii_stl);
+        out << ",\n";
+        write_stage(out, "shape_to_stl binary", result.binary_stl);
+        out << "\n      }\n";
+        out << "    }";
+    }
+    out << "\n  ]\n";
+    out << "}\n";
+}
+
+/* **************************************************************************** */
+
+
+
+int main(int argc, char** argv)
+{
+    Settings settings;
+    if (!parse_settings(argc, argv, settings))
+        return EXIT_FAILURE;
+
+    vector<Result> results;
+    for (const Workload& workload : workloads)
+    {
+        if (workload.name.find(settings.filter) == string::npos)
+            continue;
+
+        for (const size_t size : workload.sizes)
+        {
+            const size_t segments {max<size_t>(1, static_cast<size_t>(llround(size * settings.scale)))};
+            for (const auto& option_set : option_sets)
+            {
+                // Progress goes to the error stream, so the standard output
+                //     only holds the JSON.
+                cerr << "Running " << workload.name << " with " << segments
+                     << " segments and the " << option_set.first << " options" << endl;
+                results.push_back(run_case(workload, segments, option_set, settings));
+            }
+        }
+    }
+
+    if (settings.output.empty())
+    {
+        write_results(cout, results, settings);
+    }
+    else
+    {
+        ofstream f {settings.output};
+        write_results(f, results, settings);
+        if (!f.good())
+        {
+            cerr << "Failed to write the results to " << settings.output << endl;
+            return EXIT_FAILURE;
+        }
+        cerr << "Results written to: " << settings.output << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
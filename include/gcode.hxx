@@ -0,0 +1,77 @@
+#pragma once
+
+// Standard library.
+#include <string>
+#include <string_view>
+#include <functional>
+#include <cstdint>
+
+// Library public.
+#include "geometric_primitives.hxx"
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+// The kind of a move of a G-code program.
+enum class GcodeMotion
+{
+    // G0. Moves the tool as fast as possible, usually out of the material.
+    rapid,
+    // G1.
+    linear,
+    // G2. Clockwise when seen from the positive side of the plane normal.
+    clockwise_arc,
+    // G3.
+    counterclockwise_arc
+};
+
+// The plane of arcs, selected by G17, G18 and G19. The axes are listed in
+//     the order that makes them right-handed with the normal of the plane.
+enum class GcodePlane
+{
+    // G17. Normal along Z.
+    xy,
+    // G18. Normal along Y.
+    zx,
+    // G19. Normal along X.
+    yz
+};
+
+/*
+    One move of a G-code program, resolved against the modal state of the
+        program. All coordinates are absolute, whatever the distance modes in
+        effect, and are used as written: G20 and G21 don't scale anything.
+*/
+struct GcodeMove
+{
+    GcodeMotion motion;
+    Point3D start;
+    Point3D end;
+    // Arcs only. Center of the arc, at the height of the start point along
+    //     the plane normal. The end may be at another height, which makes a
+    //     helix.
+    Point3D center;
+    GcodePlane plane;
+    // Arcs only. Number of times the arc goes around its center. Arcs that
+    //     end where they start are full circles. Set by the P word.
+    uint32_t turns;
+    // Line of the program the move was read from, counting from one.
+    uint64_t line;
+};
+
+void parse_gcode(std::string_view program,
+                 const std::function<void(const GcodeMove&)>& emit,
+                 const Point3D& initial_position={0, 0, 0});
+
+void parse_gcode_file(const std::string& filepath,
+                      const std::function<void(const GcodeMove&)>& emit,
+                      const Point3D& initial_position={0, 0, 0});
+
+void append_gcode_move(const GcodeMove& move, SegmentCompound& compound);
+
+void append_gcode_move(const GcodeMove& move, SegmentList& segments);
+
+SegmentCompound read_gcode(std::string_view program,
+                           const bool include_rapids=false);
+
+SegmentCompound read_gcode_file(const std::string& filepath,
+                                const bool include_rapids=false);
@@ -0,0 +1,63 @@
+#pragma once
+
+// Standard library.
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Collects wall times and counters while a toolpath is built, meshed and
+        written. Hand a pointer to an instance to BuildOptions to enable it.
+        Without one, nothing is recorded and no clock is read.
+*/
+class Instrumentation
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    Instrumentation();
+
+    void record_span(const std::string& name,
+                     const Clock::time_point start,
+                     const Clock::time_point end,
+                     const int64_t segment=-1);
+
+    void add_to_counter(const std::string& name, const int64_t amount);
+
+    void sample_counter(const std::string& name, const int64_t value);
+
+    void write_chrome_trace(const std::string& filepath) const;
+
+    std::string summary() const;
+
+private:
+    struct Span
+    {
+        std::string name;
+        Clock::time_point start;
+        Clock::time_point end;
+        int thread;
+        int64_t segment;
+    };
+
+    struct Sample
+    {
+        std::string name;
+        Clock::time_point time;
+        int64_t value;
+    };
+
+    const Clock::time_point origin;
+
+    mutable std::mutex mutex;
+    std::vector<Span> spans;
+    std::vector<Sample> samples;
+    std::map<std::string, int64_t> counters;
+    std::map<std::thread::id, int> thread_numbers;
+
+    int thread_number();
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+// Standard library.
+#include <string>
+#include <memory>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+// Library public.
+#include "geometric_primitives.hxx"
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+class MappedFile;
+struct SegmentFileContents;
+struct SegmentRecord;
+
+// Version of the segment files written by SegmentFile. Files of any other
+//     version are refused.
+const uint32_t SEGMENT_FILE_VERSION {1};
+
+/*
+    A toolpath stored in binary form, ready to be built without parsing or 
+        fitting anything again. Write one with SegmentFile::write() or
+        SegmentFile::convert_gcode(), then open it as many times as needed.
+
+    Notes:
+        The file is mapped into memory and used in place. Curves are stored
+            as their B-spline representations, so loading them skips the
+            interpolation and conversion their constructors do.
+        Files are tied to little-endian hosts.
+*/
+class SegmentFile
+{
+    std::unique_ptr<MappedFile> file;
+
+    static void encode_line(const Line& line, SegmentFileContents& contents);
+
+    static void encode_curve(const Curve& curve,
+                             const uint32_t kind,
+                             SegmentFileContents& contents);
+
+    static void encode(const SegmentCompound& compound, SegmentFileContents& contents);
+
+    static void encode(const Segment& segment, SegmentFileContents& contents);
+
+    void decode_curve(const SegmentRecord& record, Curve& curve) const;
+
+    Segment decode_segment(const std::size_t i) const;
+
+public:
+    explicit SegmentFile(const std::string& filepath);
+    ~SegmentFile();
+
+    SegmentFile(SegmentFile&&) noexcept;
+    SegmentFile& operator=(SegmentFile&&) noexcept;
+
+    uint32_t version() const;
+
+    std::size_t segment_count() const;
+
+    std::pair<Point3D, Point3D> bounds() const;
+
+    SegmentCompound segments() const;
+
+    SegmentList segment_list() const;
+
+    static void write(const std::string& filepath, const SegmentCompound& compound);
+
+    static void write(const std::string& filepath, const SegmentList& segments);
+
+    static void convert_gcode(const std::string& gcode_filepath,
+                              const std::string& filepath,
+                              const bool include_rapids=false);
+};
@@ -0,0 +1,59 @@
+#pragma once
+
+// Standard library.
+#include <vector>
+#include <variant>
+#include <span>
+#include <utility>
+#include <cstddef>
+
+// Library public.
+#include "toolpath.hxx"
+
+// One segment of a toolpath, whatever its kind.
+typedef std::variant<Line, ArcOfCircle, InterpolatedCurve, Circle> Segment;
+
+const Path& segment_path(const Segment& segment);
+
+/*
+    The segments of a toolpath in the order in which the tool follows them,
+        stored contiguously. Unlike SegmentCompound, lines, arcs and curves
+        stay interleaved, so whatever depends on consecutive segments (shared
+        caps, coalescing, arc fitting) sees the program as it was written.
+
+    Notes:
+        Segments are moved in and never copied. ToolPath::ToolPath() reads
+            them in place.
+*/
+class SegmentList
+{
+    std::vector<Segment> list;
+
+public:
+    SegmentList() = default;
+    explicit SegmentList(SegmentCompound&& compound);
+
+    void reserve(const std::size_t count) { this->list.reserve(count); }
+    void clear() { this->list.clear(); }
+
+    void push_back(Segment&& segment) { this->list.push_back(std::move(segment)); }
+
+    // Constructs a segment of kind T in place, e.g. emplace_back<Line>(start, vector).
+    template <class T, class... Args>
+    T& emplace_back(Args&&... args)
+    {
+        return std::get<T>(this->list.emplace_back(std::in_place_type<T>, std::forward<Args>(args)...));
+    }
+
+    std::size_t size() const { return this->list.size(); }
+    bool empty() const { return this->list.empty(); }
+
+    const Segment& operator[](const std::size_t i) const { return this->list[i]; }
+
+    std::span<const Segment> segments() const { return this->list; }
+
+    std::vector<Segment>::const_iterator begin() const { return this->list.begin(); }
+    std::vector<Segment>::const_iterator end() const { return this->list.end(); }
+
+    SegmentCompound to_compound() const;
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Standard library.
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <cstddef>
+
+// Library public.
+#include "geometric_primitives.hxx"
+#include "toolpath.hxx"
+
+class SegmentList;
+struct IndexedMesh;
+
+// Splits the XY extent of a toolpath into equal cells. See TiledToolPath.
+struct TileGrid
+{
+    unsigned int columns {2};
+    unsigned int rows {2};
+};
+
+/*
+    A toolpath built as a grid of tiles rather than as one shape. Every tile
+        is the union of the segments that reach into its cell, clipped to the
+        cell, so the cost of the booleans and of meshing grows with the size
+        of a tile rather than with the size of the program. Tiles are built and
+        meshed concurrently.
+
+    Notes:
+        Every tile is a ToolPath of its own, closed by flat faces where its
+            cell ends, and can be exported on its own.
+        mesh_view() and shape_to_ply() stitch the tiles into one mesh of the
+            whole toolpath. The flat faces between cells are left out, and the
+            two sides of every seam are made to share their vertices.
+*/
+class TiledToolPath
+{
+    BuildOptions options;
+    double arc_fitting_error {0};
+    double seam_tolerance {0};
+    std::vector<ToolPath> tiles;
+    // The cell of each tile, as its lowest and its highest corner.
+    std::vector<std::pair<Point3D, Point3D>> cells;
+    // For each tile, whether each of its faces lies on a side of its cell.
+    //     Indexed by face, in the order in which TopExp_Explorer visits them.
+    std::vector<std::vector<bool>> seam_faces;
+    // Replaced by mesh_surface(), and filled by the first call to mesh_view()
+    //     after that. Null until the tiles are meshed.
+    std::shared_ptr<MeshBuffers> mesh_buffers;
+
+    IndexedMesh stitched_mesh(const double weld_tolerance) const;
+
+public:
+    TiledToolPath(const SegmentList& segments,
+                  const CylindricalTool& profile,
+                  const TileGrid& grid,
+                  const BuildOptions& options=BuildOptions());
+
+    std::size_t tile_count() const;
+
+    const ToolPath& tile(const std::size_t i) const;
+
+    std::pair<Point3D, Point3D> tile_bounds(const std::size_t i) const;
+
+    double approximation_error() const;
+
+    void mesh_surface(const double angle,
+                      const double deflection,
+                      const bool vertex_normals=true);
+
+    MeshView mesh_view() const;
+
+    void shape_to_ply(const std::string filepath,
+                      const double weld_tolerance=DEFAULT_WELD_TOLERANCE) const;
+};
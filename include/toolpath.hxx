@@ -2,13 +2,21 @@
 
 // Standard library.
 #include <vector>
+#include <tuple>
+#include <utility>
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <functional>
 
 // Third party.
 #include "TopoDS_Shape.hxx"
 #include "Geom_BSplineCurve.hxx"
+#include "Geom_Curve.hxx"
 
 // Library public.
 #include "geometric_primitives.hxx"
+#include "triangle_range.hxx"
 
 class Curve;
 class CylindricalTool;
@@ -16,34 +24,281 @@ class Line;
 class ArcOfCircle;
 class InterpolatedCurve;
 class Circle;
+class Path;
+class Instrumentation;
+class SegmentFile;
+class SegmentList;
+class TiledToolPath;
+struct MeshBuffers;
+
+typedef std::tuple<std::vector<Line>, 
+                   std::vector<ArcOfCircle>,
+                   std::vector<InterpolatedCurve>,
+                   std::vector<Circle>> SegmentCompound;
+
+// Encoding of the .stl files written by ToolPath::shape_to_stl().
+enum class StlFormat
+{
+    // Human readable text.
+    ascii,
+    // 80 byte header, triangle count and one 50 byte record per triangle.
+    //     Coordinates are little-endian float32, as the format requires.
+    binary
+};
+
+// How the per-face normals of exported meshes are computed.
+enum class FacetNormals
+{
+    // Average of the normals stored at the three corners. Needs the vertex
+    //     normals computed by mesh_surface().
+    vertex_average,
+    // Cross product of two edges, oriented out of the solid. Needs nothing
+    //     but the triangle positions.
+    geometric
+};
+
+// Compression of the mesh files written by ToolPath.
+enum class Compression
+{
+    none,
+    // The file is a series of gzip members, compressed in parallel. Any gzip
+    //     reader decompresses it as a whole. Needs the library to be built
+    //     with zlib.
+    gzip
+};
+
+// Exported vertices closer than this are merged into one.
+const double DEFAULT_WELD_TOLERANCE {1e-6};
+
+// The meshed toolpath as flat arrays, with coincident vertices merged. See 
+//     ToolPath::mesh_view().
+struct MeshView
+{
+    // Vertex i is (positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]).
+    std::span<const double> positions;
+    // Unit normal at vertex i, laid out like the positions.
+    std::span<const double> normals;
+    // Triangle i is (indices[3 * i], indices[3 * i + 1], indices[3 * i + 2]),
+    //     wound counterclockwise when seen from outside of the solid.
+    std::span<const uint32_t> indices;
+    // Triangle i is part of face face_ids[i] of the toolpath shape. Faces are
+    //     numbered in the order in which TopExp_Explorer visits them.
+    std::span<const uint32_t> face_ids;
+
+    std::size_t vertex_count() const { return this->positions.size() / 3; }
+    std::size_t triangle_count() const { return this->face_ids.size(); }
+};
+
+// How the per-segment solids are combined into the toolpath shape.
+enum class UnionMode
+{
+    // Fuse each solid into the running union, one at a time. Reference mode.
+    sequential,
+    // Fuse spatially close pairs in a balanced binary tree.
+    tree_reduction,
+    // Fuse every sweep and cap at once in a single n-ary Boolean operation.
+    general_fuse
+};
+
+struct BuildOptions
+{
+    UnionMode union_mode {UnionMode::sequential};
+    // Maximum number of worker threads used to build the per-segment solids
+    //     and to run independent fuses. Zero means one per hardware thread.
+    unsigned int threads {0};
+    // Fuzzy tolerance for UnionMode::general_fuse. Zero disables fuzzy mode.
+    double fuzzy_value {0};
+    // Use oriented bounding boxes to reject non-interfering operands early.
+    bool use_obb {true};
+    // Only fuse solids whose bounding boxes overlap. Groups of solids that
+    //     don't touch each other are gathered in a compound instead.
+    bool cluster_disjoint {false};
+    // When a segment starts where the previous segment ends, reuse the end cap
+    //     of the previous segment instead of building a start cap.
+    bool shared_caps {false};
+    // Build horizontal linear moves by extruding a stadium-shaped face, which
+    //     needs no Boolean operation for the caps.
+    bool analytic_lines {false};
+    // Build horizontal arcs and circles by revolving the profile around the
+    //     axis of the circle, rather than piping it along a B-spline.
+    bool analytic_arcs {false};
+    // Merge runs of consecutive collinear lines and consecutive arcs of the
+    //     same circle before building anything. See ToolPath::coalesce().
+    bool coalesce_segments {false};
+    // Largest distance that merging may move the path of the tool.
+    double coalesce_tolerance {1e-6};
+    // When positive, interpolated curves and dense chains of lines are replaced
+    //     by arcs and lines within this distance. See ToolPath::fit_arcs().
+    double arc_fitting_tolerance {0};
+    // When not null, receives the time spent in every stage of the build and
+    //     later in mesh_surface() and shape_to_stl(). Must outlive the toolpath.
+    Instrumentation* instrumentation {nullptr};
+    // Write binary .stl, .ply and .glb files by mapping them into memory and
+    //     filling them in place, rather than through a stream.
+    bool mapped_output {false};
+    // Compress every mesh file written. Takes precedence over mapped_output.
+    Compression output_compression {Compression::none};
+};
+
+// Shapes the stages of ToolPath::pipeline(). Every stage runs on its own
+//     threads, and hands its results to the next one through a queue.
+struct PipelineOptions
+{
+    // Also sweep the rapid moves of the program.
+    bool include_rapids {false};
+    // Number of consecutive segments handed from the parser to the sweep
+    //     stage at a time. Arc fitting and coalescing look no further than one
+    //     batch, and the union stage fuses a batch at a time.
+    std::size_t batch_segments {256};
+    // Number of batches, or of encoded blocks of faces, that may wait between
+    //     two stages. A stage that gets this far ahead of the next one waits,
+    //     which bounds the memory held in between.
+    std::size_t queue_capacity {4};
+    // Workers of the sweep stage, which builds the per-segment solids. Zero
+    //     means one per hardware thread.
+    unsigned int sweep_threads {0};
+    // Workers of each fuse of the union stage, for the union modes and the
+    //     clustering that run fuses concurrently.
+    unsigned int union_threads {0};
+    // Workers of the encoding stage, which computes normals, encodes and
+    //     compresses the faces of the meshed shape.
+    unsigned int encode_threads {0};
+};
 
 class ToolPath
 {
+    friend class TiledToolPath;
+
     TopoDS_Shape toolpath_shape_union;
+    BuildOptions options;
+    double arc_fitting_error {0};
+    // Replaced by mesh_surface(), and filled by the first call to mesh_view()
+    //     after that. Null until the toolpath is meshed.
+    std::shared_ptr<MeshBuffers> mesh_buffers;
 
     void add_shape(const TopoDS_Shape& s);
 
+    std::vector<TopoDS_Shape> curved_toolpath_parts(const Curve& curve,
+                                                    const CylindricalTool& profile,
+                                                    const bool display=false,
+                                                    const bool add_caps=true,
+                                                    const bool add_start_cap=true) const;
+
+    std::vector<TopoDS_Shape> linear_toolpath_parts(const Line& curve,
+                                                    const CylindricalTool& profile,
+                                                    const bool display=false,
+                                                    const bool add_start_cap=true) const;
+
     TopoDS_Shape curved_toolpath(const Curve& curve,
                                  const CylindricalTool& profile,
                                  const bool display=false,
-                                 const bool add_caps=true) const;
+                                 const bool add_caps=true,
+                                 const bool add_start_cap=true) const;
 
     TopoDS_Shape linear_toolpath(const Line& curve,
                                  const CylindricalTool& profile,
-                                 const bool display=false) const;
+                                 const bool display=false,
+                                 const bool add_start_cap=true) const;
+
+    std::vector<TopoDS_Shape> segment_parts(const Path& segment,
+                                            const CylindricalTool& profile,
+                                            const bool display=false,
+                                            const bool add_start_cap=true) const;
+
+    TopoDS_Shape segment_toolpath(const Path& segment,
+                                  const CylindricalTool& profile,
+                                  const bool display=false,
+                                  const bool add_start_cap=true) const;
+
+    std::pair<Point3D, Point3D> segment_endpoints(const Path& segment) const;
+
+    static std::pair<Point3D, Point3D> segment_bounds(const Path& segment);
+
+    void write_ascii_stl(const std::string& solid_name,
+                         const std::string& filepath,
+                         const FacetNormals normals) const;
+
+    void write_binary_stl(const std::string& solid_name,
+                          const std::string& filepath,
+                          const FacetNormals normals) const;
+
+    static std::vector<Line> coalesce_lines(const std::vector<Line>& lines,
+                                            const double tolerance);
+
+    static std::vector<ArcOfCircle> coalesce_arcs(const std::vector<ArcOfCircle>& arcs,
+                                                  const double tolerance);
+
+    void build(const std::vector<const Path*>& segments,
+               const CylindricalTool& profile,
+               const bool display);
+
+    std::vector<bool> segment_start_caps(const std::vector<const Path*>& segments) const;
+
+    explicit ToolPath(const BuildOptions& options) : options(options) {}
 
 public:
-    ToolPath(const std::tuple<std::vector<Line>, 
-                              std::vector<ArcOfCircle>,
-                              std::vector<InterpolatedCurve>,
-                              std::vector<Circle>> compound,
+    ToolPath(const SegmentCompound& compound,
+             const CylindricalTool& profile,
+             const bool display=false,
+             const BuildOptions& options=BuildOptions());
+
+    ToolPath(const SegmentList& segments,
              const CylindricalTool& profile,
-             const bool display=false);
+             const bool display=false,
+             const BuildOptions& options=BuildOptions());
+
+    static SegmentCompound coalesce(const SegmentCompound& compound,
+                                    const double tolerance);
+
+    static SegmentList coalesce(const SegmentList& segments,
+                                const double tolerance);
+
+    static SegmentCompound fit_arcs(const SegmentCompound& compound,
+                                    const double tolerance,
+                                    double& max_error);
+
+    static SegmentList fit_arcs(const SegmentList& segments,
+                                const double tolerance,
+                                double& max_error);
 
-    void mesh_surface(const double angle, const double deflection);
+    static ToolPath pipeline(const std::string& gcode_filepath,
+                             const CylindricalTool& profile,
+                             const double angle,
+                             const double deflection,
+                             const std::string& solid_name,
+                             const std::string& stl_filepath,
+                             const StlFormat format=StlFormat::binary,
+                             const FacetNormals normals=FacetNormals::vertex_average,
+                             const BuildOptions& options=BuildOptions(),
+                             const PipelineOptions& pipeline_options=PipelineOptions());
+
+    double approximation_error() const;
+
+    void mesh_surface(const double angle, 
+                      const double deflection,
+                      const bool vertex_normals=true);
 
     void shape_to_stl(const std::string solid_name, 
-                      const std::string filepath) const;
+                      const std::string filepath,
+                      const StlFormat format=StlFormat::ascii,
+                      const FacetNormals normals=FacetNormals::vertex_average) const;
+
+    void shape_to_ply(const std::string filepath,
+                      const double weld_tolerance=DEFAULT_WELD_TOLERANCE) const;
+
+    void shape_to_obj(const std::string filepath,
+                      const double weld_tolerance=DEFAULT_WELD_TOLERANCE) const;
+
+    void shape_to_glb(const std::string filepath,
+                      const bool normals=true,
+                      const double weld_tolerance=DEFAULT_WELD_TOLERANCE) const;
+
+    MeshView mesh_view() const;
+
+    TriangleRange triangles() const;
+
+    void for_each_triangle_batch(const std::size_t batch_size,
+                                 const std::function<void(std::span<const Triangle>)>& consume) const;
 };
 
 struct CylindricalTool
@@ -61,9 +316,13 @@ public:
 class Curve : public Path
 {
     friend class ToolPath;
+    friend class SegmentFile;
 
 protected:
     Handle(Geom_BSplineCurve) representation; 
+    // The curve before conversion to a B-spline, when it has a simpler exact
+    //     form (e.g. a circle). Null otherwise.
+    Handle(Geom_Curve) exact_representation;
 
 public:
     virtual ~Curve() = 0;
@@ -71,6 +330,11 @@ public:
 
 class InterpolatedCurve : public Curve
 {
+    friend class SegmentFile;
+
+    // Left empty for SegmentFile, which restores stored representations.
+    InterpolatedCurve() = default;
+
 public:
     InterpolatedCurve(const std::vector<Point3D>& interpolation_points,
                       const std::vector<std::pair<uint64_t, Vec3D>>& tangents);
@@ -78,6 +342,10 @@ public:
 
 class ArcOfCircle : public Curve
 {
+    friend class SegmentFile;
+
+    ArcOfCircle() = default;
+
 public:
     ArcOfCircle(const std::pair<Point3D, Point3D>& arc_endpoints,
                 const Point3D& interior_point);
@@ -85,6 +353,10 @@ public:
 
 class Circle : public Curve
 {
+    friend class SegmentFile;
+
+    Circle() = default;
+
 public:
     Circle(const Point3D& p1, const Point3D& p2, const Point3D& p3);
 };
@@ -92,6 +364,7 @@ public:
 class Line : public Path
 {
     friend class ToolPath; 
+    friend class SegmentFile;
 
     Vec3D line;
     Point3D start_point;
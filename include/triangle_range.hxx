@@ -0,0 +1,83 @@
+#pragma once
+
+// Standard library.
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+
+// Third party.
+#include "TopoDS_Shape.hxx"
+#include "TopExp_Explorer.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library public.
+#include "geometric_primitives.hxx"
+
+// One triangle of the meshed toolpath.
+struct Triangle
+{
+    // Wound counterclockwise when seen from outside of the solid.
+    std::array<Point3D, 3> vertices;
+    // Unit normal following the winding. Zero for degenerate triangles.
+    Vec3D normal;
+    // The face of the toolpath shape that the triangle is part of. Faces are
+    //     numbered in the order in which TopExp_Explorer visits them.
+    uint32_t face_id;
+};
+
+/*
+    Walks the triangles of a meshed shape one at a time, face by face, without
+        storing them anywhere. Memory use doesn't depend on the size of the 
+        mesh. See ToolPath::triangles().
+
+    Notes:
+        This is a single pass range: begin() may only be called once.
+        The range refers to the triangulations of the shape, so the shape must
+            not be meshed again while the range is in use.
+*/
+class TriangleRange
+{
+    TopoDS_Shape shape;
+    // Held by pointer because explorers can't be copied or moved safely.
+    std::unique_ptr<TopExp_Explorer> face_it;
+    Handle(Poly_Triangulation) poly_tri;
+    bool reversed {false};
+    int next_triangle {1};
+    uint32_t face_id {0};
+    Triangle current {};
+    bool done {false};
+
+    void advance();
+
+public:
+    class Iterator
+    {
+        TriangleRange* range {nullptr};
+
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef Triangle value_type;
+        typedef std::ptrdiff_t difference_type;
+
+        Iterator() = default;
+        explicit Iterator(TriangleRange* const range) : range(range) {}
+
+        const Triangle& operator*() const { return this->range->current; }
+        const Triangle* operator->() const { return &this->range->current; }
+
+        Iterator& operator++() { this->range->advance(); return *this; }
+        void operator++(int) { this->range->advance(); }
+
+        bool operator==(std::default_sentinel_t) const { return this->range->done; }
+    };
+
+    explicit TriangleRange(const TopoDS_Shape& shape);
+
+    TriangleRange(TriangleRange&&) = default;
+    TriangleRange& operator=(TriangleRange&&) = default;
+
+    Iterator begin();
+    std::default_sentinel_t end() const { return std::default_sentinel; }
+};
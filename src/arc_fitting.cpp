@@ -0,0 +1,277 @@
+// Standard library.
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <cmath>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "gp_Vec.hxx"
+#include "Geom_BSplineCurve.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "biarc_p.hxx"
+
+/* 
+   ****************************************************************************
+                           File Local Declarations 
+   ****************************************************************************
+*/ 
+
+// Consecutive lines that turn by more than this angle meet at a real corner,
+//     rather than approximating a smooth curve, and are never fitted.
+const double MAX_CHAIN_TURN_ANGLE {M_PI / 6};
+
+// Chains with fewer lines than this are left alone.
+const std::size_t MIN_CHAIN_LINES {3};
+
+static Point3D to_point3d(const gp_Pnt& p);
+
+static gp_Pnt line_end(const Point3D& start, const Vec3D& line);
+
+static bool continues_chain(const Point3D& previous_start,
+                            const Vec3D& previous_line,
+                            const Point3D& next_start,
+                            const Vec3D& next_line);
+
+static std::vector<double> knots_of(const Handle(Geom_BSplineCurve)& bspline);
+
+static void append_pieces(const std::vector<ArcPiece>& pieces,
+                          std::vector<Line>& lines,
+                          std::vector<ArcOfCircle>& arcs);
+
+static void append_pieces(const std::vector<ArcPiece>& pieces,
+                          SegmentList& segments);
+
+/* **************************************************************************** */
+
+
+/* 
+   ****************************************************************************
+                           File Local Definitions 
+   ****************************************************************************
+*/ 
+
+static Point3D to_point3d(const gp_Pnt& p)
+{
+    return Point3D {p.X(), p.Y(), p.Z()};
+}
+
+static gp_Pnt line_end(const Point3D& start, const Vec3D& line)
+{
+    return gp_Pnt {start[0] + line[0], start[1] + line[1], start[2] + line[2]};
+}
+
+/*
+    Whether a line continues the chain that the previous line belongs to: it
+        starts where the previous line ends and turns by no more than
+        MAX_CHAIN_TURN_ANGLE.
+*/
+static bool continues_chain(const Point3D& previous_start,
+                            const Vec3D& previous_line,
+                            const Point3D& next_start,
+                            const Vec3D& next_line)
+{
+    const gp_Pnt start {next_start[0], next_start[1], next_start[2]};
+    if (start.Distance(line_end(previous_start, previous_line)) > FP_EQUALS_TOLERANCE)
+        return false;
+
+    const gp_Vec previous_direction {previous_line[0], previous_line[1], previous_line[2]};
+    const gp_Vec next_direction {next_line[0], next_line[1], next_line[2]};
+    if (previous_direction.Magnitude() < FP_EQUALS_TOLERANCE or next_direction.Magnitude() < FP_EQUALS_TOLERANCE)
+        return false;
+    return previous_direction.Angle(next_direction) <= MAX_CHAIN_TURN_ANGLE;
+}
+
+static std::vector<double> knots_of(const Handle(Geom_BSplineCurve)& bspline)
+{
+    std::vector<double> knots;
+    for (int i {1}; i <= bspline->NbKnots(); ++i)
+        knots.push_back(bspline->Knot(i));
+    return knots;
+}
+
+static void append_pieces(const std::vector<ArcPiece>& pieces,
+                          std::vector<Line>& lines,
+                          std::vector<ArcOfCircle>& arcs)
+{
+    for (const ArcPiece& piece : pieces)
+    {
+        if (piece.straight)
+            lines.emplace_back(to_point3d(piece.start), Vec3D {piece.end.X() - piece.start.X(),
+                                                               piece.end.Y() - piece.start.Y(),
+                                                               piece.end.Z() - piece.start.Z()});
+        else
+            arcs.emplace_back(std::pair<Point3D, Point3D> {to_point3d(piece.start), to_point3d(piece.end)},
+                              to_point3d(piece.interior));
+    }
+}
+
+static void append_pieces(const std::vector<ArcPiece>& pieces,
+                          SegmentList& segments)
+{
+    for (const ArcPiece& piece : pieces)
+    {
+        if (piece.straight)
+            segments.emplace_back<Line>(to_point3d(piece.start), Vec3D {piece.end.X() - piece.start.X(),
+                                                                        piece.end.Y() - piece.start.Y(),
+                                                                        piece.end.Z() - piece.start.Z()});
+        else
+            segments.emplace_back<ArcOfCircle>(std::pair<Point3D, Point3D> {to_point3d(piece.start), to_point3d(piece.end)},
+                                               to_point3d(piece.interior));
+    }
+}
+
+/* **************************************************************************** */
+
+/*
+    Replaces interpolated curves, and dense chains of lines, by sequences of
+        lines and arcs of circles that stay within a tolerance of the original
+        path (biarc fitting). Lines and arcs are swept with the fast analytic
+        paths, while sweeps along B-splines are slow and fragile.
+
+    Notes:
+        A chain is a run of at least MIN_CHAIN_LINES consecutive lines in which
+            each line starts where the previous one ends and turns by no more 
+            than MAX_CHAIN_TURN_ANGLE.
+        The pieces fitted to a curve or chain are appended to the lists of lines
+            and arcs. The lines of a chain are replaced where the chain was.
+        Circles and existing arcs are kept as is.
+
+    Arguments:
+        compound:  The segments that make up the toolpath.
+        tolerance: Largest allowed distance between the original path and the
+                       fitted path.
+        max_error: Raised to the largest deviation measured between the original
+                       path and the fitted path, if larger than its current
+                       value. Compare it against the tolerance of the part.
+
+    Returns:
+        The segments with curves and chains replaced.
+*/
+SegmentCompound ToolPath::fit_arcs(const SegmentCompound& compound,
+                                   const double tolerance,
+                                   double& max_error)
+{
+    std::vector<Line> lines;
+    std::vector<ArcOfCircle> arcs {get<1>(compound)};
+    const std::vector<Line>& original_lines {get<0>(compound)};
+
+    const auto end_of = [](const Line& l)
+    {
+        return line_end(l.start_point, l.line);
+    };
+    const auto continues = [](const Line& previous, const Line& next)
+    {
+        return continues_chain(previous.start_point, previous.line, next.start_point, next.line);
+    };
+
+    std::size_t chain_first {0};
+    while (chain_first < original_lines.size())
+    {
+        std::size_t chain_last {chain_first + 1};
+        while (chain_last < original_lines.size() and continues(original_lines[chain_last - 1], original_lines[chain_last]))
+            ++chain_last;
+
+        if (chain_last - chain_first < MIN_CHAIN_LINES)
+        {
+            lines.insert(lines.end(), original_lines.begin() + chain_first, original_lines.begin() + chain_last);
+        }
+        else
+        {
+            const Point3D& first_point {original_lines[chain_first].start_point};
+            std::vector<gp_Pnt> polyline {gp_Pnt {first_point[0], first_point[1], first_point[2]}};
+            for (std::size_t i {chain_first}; i < chain_last; ++i)
+                polyline.push_back(end_of(original_lines[i]));
+
+            append_pieces(fit_biarcs(polyline, tolerance, max_error), lines, arcs);
+        }
+
+        chain_first = chain_last;
+    }
+
+    for (const InterpolatedCurve& c : get<2>(compound))
+    {
+        const Handle(Geom_BSplineCurve)& bspline {c.representation};
+        append_pieces(fit_biarcs(bspline, knots_of(bspline), tolerance, max_error), lines, arcs);
+    }
+
+    return SegmentCompound {lines, arcs, std::vector<InterpolatedCurve> {}, get<3>(compound)};
+}
+
+/*
+    See the overload above. Chains are runs of consecutive lines of the list,
+        and the pieces fitted to a chain or a curve take its place in the
+        list, so the order of the list is kept.
+*/
+SegmentList ToolPath::fit_arcs(const SegmentList& segments,
+                               const double tolerance,
+                               double& max_error)
+{
+    SegmentList fitted;
+    fitted.reserve(segments.size());
+
+    const auto continues = [&segments](const std::size_t i)
+    {
+        const Line* const previous {std::get_if<Line>(&segments[i - 1])};
+        const Line* const next {std::get_if<Line>(&segments[i])};
+        return previous and next and
+               continues_chain(previous->start_point, previous->line, next->start_point, next->line);
+    };
+
+    std::size_t first {0};
+    while (first < segments.size())
+    {
+        if (const InterpolatedCurve* const c {std::get_if<InterpolatedCurve>(&segments[first])})
+        {
+            const Handle(Geom_BSplineCurve)& bspline {c->representation};
+            append_pieces(fit_biarcs(bspline, knots_of(bspline), tolerance, max_error), fitted);
+            ++first;
+            continue;
+        }
+
+        std::size_t last {first + 1};
+        while (last < segments.size() and continues(last))
+            ++last;
+
+        if (last - first < MIN_CHAIN_LINES)
+        {
+            for (std::size_t i {first}; i < last; ++i)
+                fitted.push_back(Segment {segments[i]});
+        }
+        else
+        {
+            const Point3D& first_point {std::get<Line>(segments[first]).start_point};
+            std::vector<gp_Pnt> polyline {gp_Pnt {first_point[0], first_point[1], first_point[2]}};
+            for (std::size_t i {first}; i < last; ++i)
+            {
+                const Line& l {std::get<Line>(segments[i])};
+                polyline.push_back(line_end(l.start_point, l.line));
+            }
+
+            append_pieces(fit_biarcs(polyline, tolerance, max_error), fitted);
+        }
+
+        first = last;
+    }
+
+    return fitted;
+}
+
+/*
+    Largest deviation between the toolpath that was asked for and the toolpath
+        that was built, introduced by arc fitting. Zero if no arc fitting was
+        done.
+*/
+double ToolPath::approximation_error() const
+{
+    return this->arc_fitting_error;
+}
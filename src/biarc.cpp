@@ -0,0 +1,405 @@
+// Standard library.
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "gp.hxx"
+#include "gp_Pnt.hxx"
+#include "gp_Vec.hxx"
+#include "Geom_Curve.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "biarc_p.hxx"
+
+/* 
+   ****************************************************************************
+                           File Local Declarations 
+   ****************************************************************************
+*/ 
+
+// Number of points at which a curve is compared to the biarc fitted to it.
+const int SAMPLES_PER_SPAN {16};
+
+// Limits how many times a span of a curve is halved when no biarc fits it.
+const int MAX_SPLIT_DEPTH {16};
+
+// An arc of a circle in space, or a straight line segment, as used while
+//     fitting. Points on the arc are center + radius * (cos(a) * u + sin(a) * v)
+//     for a in [0, sweep].
+struct SpaceArc
+{
+    gp_Pnt start;
+    gp_Pnt end;
+    bool straight;
+    gp_Pnt center;
+    gp_Vec u;
+    gp_Vec v;
+    double radius;
+    double sweep;
+};
+
+static double distance_to_segment(const gp_Pnt& p, const gp_Pnt& a, const gp_Pnt& b);
+
+static double angle_on_arc(const SpaceArc& arc, const gp_Pnt& p);
+
+static gp_Pnt point_on_arc(const SpaceArc& arc, const double angle);
+
+static gp_Vec end_tangent(const SpaceArc& arc);
+
+static SpaceArc make_arc(const gp_Pnt& start, 
+                         const gp_Vec& tangent, 
+                         const gp_Pnt& end,
+                         const double tolerance);
+
+static std::array<SpaceArc, 2> make_biarc(const gp_Pnt& p0, const gp_Vec& t0,
+                                          const gp_Pnt& p1, const gp_Vec& t1,
+                                          const double tolerance);
+
+static double distance_to_biarc(const std::array<SpaceArc, 2>& biarc, const gp_Pnt& p);
+
+static void append_biarc(const std::array<SpaceArc, 2>& biarc, std::vector<ArcPiece>& pieces);
+
+static gp_Vec unit_or(const gp_Vec& v, const gp_Vec& fallback);
+
+static void fit_span(const Handle(Geom_Curve)& curve, 
+                     const double first, 
+                     const double last,
+                     const double tolerance,
+                     const int depth,
+                     std::vector<ArcPiece>& pieces,
+                     double& max_error);
+
+/* **************************************************************************** */
+
+
+/* 
+   ****************************************************************************
+                           File Local Definitions 
+   ****************************************************************************
+*/ 
+
+static double distance_to_segment(const gp_Pnt& p, const gp_Pnt& a, const gp_Pnt& b)
+{
+    const gp_Vec ab {a, b};
+    const double length_squared {ab.SquareMagnitude()};
+    if (length_squared < FP_EQUALS_TOLERANCE * FP_EQUALS_TOLERANCE)
+        return p.Distance(a);
+
+    const double t {std::clamp(gp_Vec(a, p).Dot(ab) / length_squared, 0., 1.)};
+    return p.Distance(a.Translated(ab * t));
+}
+
+/*
+    Computes the angle, in [0, 2pi), of the projection of a point onto the plane
+        of an arc, measured from the start of the arc in its direction of travel.
+*/
+static double angle_on_arc(const SpaceArc& arc, const gp_Pnt& p)
+{
+    const gp_Vec w {arc.center, p};
+    double angle {std::atan2(w.Dot(arc.v), w.Dot(arc.u))};
+    if (angle < 0)
+        angle += 2 * M_PI;
+    return angle;
+}
+
+static gp_Pnt point_on_arc(const SpaceArc& arc, const double angle)
+{
+    return arc.center.Translated(arc.u * (arc.radius * std::cos(angle)) + 
+                                 arc.v * (arc.radius * std::sin(angle)));
+}
+
+/*
+    Unit tangent at the end point of an arc, in its direction of travel.
+*/
+static gp_Vec end_tangent(const SpaceArc& arc)
+{
+    if (arc.straight)
+        return gp_Vec(arc.start, arc.end).Normalized();
+    return arc.u * (-std::sin(arc.sweep)) + arc.v * std::cos(arc.sweep);
+}
+
+/*
+    Constructs the arc that starts at a point with a given tangent and ends at
+        another point. Such an arc always exists and lies in the plane spanned
+        by the tangent and the chord. When the chord is (nearly) along the
+        tangent, the arc degenerates to a straight line.
+
+    Notes:
+        An arc whose sagitta is within the tolerance is replaced by its chord.
+            Nearly straight spans, like chains of lines with a little noise,
+            would otherwise give arcs of huge radius, which are slow and
+            fragile to sweep.
+
+    Arguments:
+        start:     Start point of the arc.
+        tangent:   Unit tangent of the arc at the start point.
+        end:       End point of the arc.
+        tolerance: Largest distance between the arc and its chord for which
+                       the chord is used instead.
+*/
+static SpaceArc make_arc(const gp_Pnt& start, 
+                         const gp_Vec& tangent, 
+                         const gp_Pnt& end,
+                         const double tolerance)
+{
+    SpaceArc arc {};
+    arc.start = start;
+    arc.end = end;
+    arc.straight = true;
+
+    // The part of the chord perpendicular to the tangent points toward the
+    //     center. When it vanishes, there is no circle to construct.
+    const gp_Vec chord {start, end};
+    const gp_Vec perpendicular {chord - tangent * chord.Dot(tangent)};
+    if (perpendicular.Magnitude() < FP_EQUALS_TOLERANCE)
+        return arc;
+
+    const gp_Vec toward_center {perpendicular.Normalized()};
+    arc.radius = chord.SquareMagnitude() / (2 * chord.Dot(toward_center));
+    arc.center = start.Translated(toward_center * arc.radius);
+    arc.u = -toward_center;
+    arc.v = tangent;
+    arc.sweep = angle_on_arc(arc, end);
+    arc.straight = arc.radius * (1 - std::cos(arc.sweep / 2)) <= tolerance;
+    return arc;
+}
+
+/*
+    Constructs the biarc between two points with given unit tangents: two arcs
+        that meet with a common tangent, the first leaving p0 along t0 and the
+        second arriving at p1 along t1. Both arcs are given the same tangent
+        length d, which determines the point where they meet.
+*/
+static std::array<SpaceArc, 2> make_biarc(const gp_Pnt& p0, const gp_Vec& t0,
+                                          const gp_Pnt& p1, const gp_Vec& t1,
+                                          const double tolerance)
+{
+    const gp_Vec v {p0, p1};
+    const gp_Vec t {t0 + t1};
+    const double denominator {2 * (1 - t0.Dot(t1))};
+
+    double d;
+    if (std::abs(denominator) > FP_EQUALS_TOLERANCE)
+        d = (-v.Dot(t) + std::sqrt(std::pow(v.Dot(t), 2) + denominator * v.SquareMagnitude())) / denominator;
+    else if (std::abs(v.Dot(t1)) > FP_EQUALS_TOLERANCE)
+        d = v.SquareMagnitude() / (4 * v.Dot(t1));
+    else
+        d = v.Magnitude() / 2;
+
+    const gp_Pnt joint {p0.Translated(v * .5 + (t0 - t1) * (d / 2))};
+    const SpaceArc first {make_arc(p0, t0, joint, tolerance)};
+    const SpaceArc second {make_arc(joint, end_tangent(first), p1, tolerance)};
+    return {first, second};
+}
+
+static double distance_to_arc(const SpaceArc& arc, const gp_Pnt& p)
+{
+    if (arc.straight)
+        return distance_to_segment(p, arc.start, arc.end);
+
+    if (angle_on_arc(arc, p) > arc.sweep)
+        return std::min(p.Distance(arc.start), p.Distance(arc.end));
+
+    const gp_Vec w {arc.center, p};
+    const double out_of_plane {w.Dot(arc.u.Crossed(arc.v))};
+    const double in_plane {std::sqrt(std::max(0., w.SquareMagnitude() - out_of_plane * out_of_plane))};
+    return std::hypot(out_of_plane, in_plane - arc.radius);
+}
+
+static double distance_to_biarc(const std::array<SpaceArc, 2>& biarc, const gp_Pnt& p)
+{
+    return std::min(distance_to_arc(biarc[0], p), distance_to_arc(biarc[1], p));
+}
+
+static void append_biarc(const std::array<SpaceArc, 2>& biarc, std::vector<ArcPiece>& pieces)
+{
+    for (const SpaceArc& arc : biarc)
+    {
+        // The joint can coincide with an end point, leaving an empty arc.
+        if (arc.start.Distance(arc.end) < FP_EQUALS_TOLERANCE)
+            continue;
+
+        ArcPiece piece {arc.start, arc.end, arc.start, arc.straight};
+        if (!arc.straight)
+            piece.interior = point_on_arc(arc, arc.sweep / 2);
+        pieces.push_back(piece);
+    }
+}
+
+static gp_Vec unit_or(const gp_Vec& v, const gp_Vec& fallback)
+{
+    if (v.Magnitude() < FP_EQUALS_TOLERANCE)
+        return fallback.Normalized();
+    return v.Normalized();
+}
+
+/*
+    Fits a biarc to the part of a curve between two parameters, halving the
+        part until the biarc is within tolerance or the depth limit is hit.
+*/
+static void fit_span(const Handle(Geom_Curve)& curve, 
+                     const double first, 
+                     const double last,
+                     const double tolerance,
+                     const int depth,
+                     std::vector<ArcPiece>& pieces,
+                     double& max_error)
+{
+    gp_Pnt p0, p1;
+    gp_Vec d0, d1;
+    curve->D1(first, p0, d0);
+    curve->D1(last, p1, d1);
+    if (p0.Distance(p1) < FP_EQUALS_TOLERANCE)
+        return;
+
+    const gp_Vec chord {p0, p1};
+    const std::array<SpaceArc, 2> biarc {make_biarc(p0, unit_or(d0, chord), p1, unit_or(d1, chord), tolerance)};
+
+    double error {0};
+    for (int i {1}; i < SAMPLES_PER_SPAN; ++i)
+    {
+        const gp_Pnt p {curve->Value(first + (last - first) * i / SAMPLES_PER_SPAN)};
+        error = std::max(error, distance_to_biarc(biarc, p));
+    }
+
+    if (error > tolerance and depth < MAX_SPLIT_DEPTH)
+    {
+        const double middle {(first + last) / 2};
+        fit_span(curve, first, middle, tolerance, depth + 1, pieces, max_error);
+        fit_span(curve, middle, last, tolerance, depth + 1, pieces, max_error);
+        return;
+    }
+
+    max_error = std::max(max_error, error);
+    append_biarc(biarc, pieces);
+}
+
+/* **************************************************************************** */
+
+/*
+    Approximates a curve by a G1 continuous sequence of arcs and lines (biarc
+        fitting).
+
+    Notes:
+        The deviation is measured at SAMPLES_PER_SPAN points of every span, so
+            it is an estimate of the true deviation, not a strict bound.
+        A span is halved at most MAX_SPLIT_DEPTH times. If a span still doesn't
+            fit then, its biarc is used anyway and its deviation is included in
+            max_error, which then exceeds the tolerance.
+
+    Arguments:
+        curve:     The curve to approximate. 
+        breaks:    Increasing parameters at which the curve is split before
+                       fitting (e.g. its knots). Must contain the first and the
+                       last parameter of the curve.
+        tolerance: Largest allowed distance between the curve and the
+                       approximation.
+        max_error: Raised to the largest deviation of the approximation from
+                       the curve, if larger than its current value.
+
+    Returns:
+        The pieces of the approximation, in order along the curve.
+*/
+std::vector<ArcPiece> fit_biarcs(const Handle(Geom_Curve)& curve,
+                                 const std::vector<double>& breaks,
+                                 const double tolerance,
+                                 double& max_error)
+{
+    assert(breaks.size() >= 2);
+
+    std::vector<ArcPiece> pieces;
+    for (std::size_t i {1}; i < breaks.size(); ++i)
+        fit_span(curve, breaks[i - 1], breaks[i], tolerance, 0, pieces, max_error);
+    return pieces;
+}
+
+/*
+    Approximates a dense chain of line segments by a G1 continuous sequence of
+        arcs and lines (biarc fitting). The tangent at each vertex is estimated
+        from its neighbours. Runs of vertices are covered greedily by the
+        longest biarc that stays within tolerance.
+
+    Notes:
+        The deviation is measured at the vertices of the chain and at the
+            midpoints of its segments.
+        A segment that no biarc fits within tolerance is kept as a line, so the
+            result is never further than tolerance from the chain at the
+            measured points.
+
+    Arguments:
+        polyline:  Vertices of the chain, at least two.
+        tolerance: Largest allowed distance between the chain and the
+                       approximation.
+        max_error: Raised to the largest deviation of the approximation from
+                       the chain, if larger than its current value.
+
+    Returns:
+        The pieces of the approximation, in order along the chain.
+*/
+std::vector<ArcPiece> fit_biarcs(const std::vector<gp_Pnt>& polyline,
+                                 const double tolerance,
+                                 double& max_error)
+{
+    assert(polyline.size() >= 2);
+    const std::size_t last {polyline.size() - 1};
+
+    std::vector<gp_Vec> tangents(polyline.size());
+    tangents.front() = unit_or(gp_Vec(polyline[0], polyline[1]), gp::DX());
+    tangents.back() = unit_or(gp_Vec(polyline[last - 1], polyline[last]), gp::DX());
+    for (std::size_t i {1}; i < last; ++i)
+        tangents[i] = unit_or(gp_Vec(polyline[i - 1], polyline[i + 1]), gp_Vec(polyline[i - 1], polyline[i]));
+
+    // Deviation of the biarc from the chain between vertices i and j.
+    const auto deviation = [&](const std::array<SpaceArc, 2>& biarc, const std::size_t i, const std::size_t j)
+    {
+        double error {0};
+        for (std::size_t k {i}; k < j; ++k)
+        {
+            const gp_Pnt middle {polyline[k].Translated(gp_Vec(polyline[k], polyline[k + 1]) * .5)};
+            error = std::max(error, distance_to_biarc(biarc, middle));
+            if (k > i)
+                error = std::max(error, distance_to_biarc(biarc, polyline[k]));
+        }
+        return error;
+    };
+
+    std::vector<ArcPiece> pieces;
+    std::size_t i {0};
+    while (i < last)
+    {
+        std::size_t best_end {i};
+        std::array<SpaceArc, 2> best_biarc {};
+        double best_error {0};
+        for (std::size_t j {i + 1}; j <= last; ++j)
+        {
+            const std::array<SpaceArc, 2> biarc {make_biarc(polyline[i], tangents[i], polyline[j], tangents[j], tolerance)};
+            const double error {deviation(biarc, i, j)};
+            if (error > tolerance)
+                break;
+
+            best_end = j;
+            best_biarc = biarc;
+            best_error = error;
+        }
+
+        if (best_end == i)
+        {
+            // Not even the next segment is fitted well. Keep it as it is.
+            pieces.push_back(ArcPiece {polyline[i], polyline[i + 1], polyline[i], true});
+            i += 1;
+            continue;
+        }
+
+        max_error = std::max(max_error, best_error);
+        append_biarc(best_biarc, pieces);
+        i = best_end;
+    }
+
+    return pieces;
+}
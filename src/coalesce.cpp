@@ -0,0 +1,303 @@
+// Standard library.
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "gp_Vec.hxx"
+#include "gp_Circ.hxx"
+#include "Geom_Circle.hxx"
+#include "Geom_TrimmedCurve.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+// Library private.
+#include "util_p.hxx"
+
+/* 
+   ****************************************************************************
+                           File Local Declarations 
+   ****************************************************************************
+*/ 
+
+// Beyond this sweep angle, the end points of a merged arc get close enough to
+//     each other that defining the arc by three points is poorly conditioned.
+const double MAX_COALESCED_ARC_ANGLE {1.5 * M_PI};
+
+static gp_Pnt to_gp_pnt(const Point3D& p);
+
+static Point3D to_point3d(const gp_Pnt& p);
+
+static double distance_to_segment(const gp_Pnt& p, const gp_Pnt& a, const gp_Pnt& b);
+
+/* **************************************************************************** */
+
+
+/* 
+   ****************************************************************************
+                           File Local Definitions 
+   ****************************************************************************
+*/ 
+
+static gp_Pnt to_gp_pnt(const Point3D& p)
+{
+    return gp_Pnt {p[0], p[1], p[2]};
+}
+
+static Point3D to_point3d(const gp_Pnt& p)
+{
+    return Point3D {p.X(), p.Y(), p.Z()};
+}
+
+/*
+    Computes the distance from a point to the closest point of the line segment
+        between a and b.
+*/
+static double distance_to_segment(const gp_Pnt& p, const gp_Pnt& a, const gp_Pnt& b)
+{
+    const gp_Vec ab {a, b};
+    const double length_squared {ab.SquareMagnitude()};
+    if (length_squared < FP_EQUALS_TOLERANCE * FP_EQUALS_TOLERANCE)
+        return p.Distance(a);
+
+    const double t {std::clamp(gp_Vec(a, p).Dot(ab) / length_squared, 0., 1.)};
+    return p.Distance(a.Translated(ab * t));
+}
+
+/* **************************************************************************** */
+
+/*
+    Merges runs of consecutive segments that describe the same path of the tool
+        with fewer segments. Every segment costs a sweep and at least one fuse,
+        so fewer segments directly means less work.
+
+    Notes:
+        Only lines that follow each other in the list of lines, and arcs that
+            follow each other in the list of arcs, are considered. Interpolated
+            curves and circles are kept as is.
+        Segments that aren't merged are kept unchanged.
+
+    Arguments:
+        compound:  The segments that make up the toolpath.
+        tolerance: Largest distance from the original path at which a point of
+                       a merged segment may lie.
+
+    Returns:
+        The coalesced segments.
+*/
+SegmentCompound ToolPath::coalesce(const SegmentCompound& compound,
+                                   const double tolerance)
+{
+    return SegmentCompound {coalesce_lines(get<0>(compound), tolerance),
+                            coalesce_arcs(get<1>(compound), tolerance),
+                            get<2>(compound),
+                            get<3>(compound)};
+}
+
+/*
+    See the overload above. Runs of consecutive lines and runs of consecutive
+        arcs of the list are merged, so a line is never merged across an arc
+        that separates it from the next line, and the order of the list is
+        kept.
+*/
+SegmentList ToolPath::coalesce(const SegmentList& segments,
+                               const double tolerance)
+{
+    SegmentList coalesced;
+    coalesced.reserve(segments.size());
+
+    std::size_t first {0};
+    while (first < segments.size())
+    {
+        const std::size_t kind {segments[first].index()};
+        std::size_t last {first + 1};
+        while (last < segments.size() and segments[last].index() == kind)
+            ++last;
+
+        if (std::holds_alternative<Line>(segments[first]))
+        {
+            std::vector<Line> lines;
+            lines.reserve(last - first);
+            for (std::size_t i {first}; i < last; ++i)
+                lines.push_back(std::get<Line>(segments[i]));
+            for (Line& l : coalesce_lines(lines, tolerance))
+                coalesced.push_back(std::move(l));
+        }
+        else if (std::holds_alternative<ArcOfCircle>(segments[first]))
+        {
+            std::vector<ArcOfCircle> arcs;
+            arcs.reserve(last - first);
+            for (std::size_t i {first}; i < last; ++i)
+                arcs.push_back(std::get<ArcOfCircle>(segments[i]));
+            for (ArcOfCircle& c : coalesce_arcs(arcs, tolerance))
+                coalesced.push_back(std::move(c));
+        }
+        else
+        {
+            for (std::size_t i {first}; i < last; ++i)
+                coalesced.push_back(Segment {segments[i]});
+        }
+        first = last;
+    }
+    return coalesced;
+}
+
+/*
+    Merges runs of lines in which each line starts where the previous one ends,
+        and in which the points where consecutive lines meet all lie within 
+        tolerance of the straight line from the start of the run to its end.
+        Since the distance is measured to the merged segment rather than to its
+        supporting line, a move that doubles back is never merged away.
+
+    Arguments:
+        lines:     Lines in the order in which the tool follows them.
+        tolerance: Largest distance allowed between a point where two lines
+                       meet and the merged line.
+
+    Returns:
+        The merged lines.
+*/
+std::vector<Line> ToolPath::coalesce_lines(const std::vector<Line>& lines,
+                                           const double tolerance)
+{
+    std::vector<Line> merged;
+
+    std::size_t run_first {0};
+    while (run_first < lines.size())
+    {
+        const Line& first {lines[run_first]};
+        const gp_Pnt run_start {to_gp_pnt(first.start_point)};
+        gp_Pnt run_end {run_start.Translated(gp_Vec(first.line[0], first.line[1], first.line[2]))};
+
+        // Points where the lines of the run meet.
+        std::vector<gp_Pnt> junctions;
+
+        std::size_t run_last {run_first + 1};
+        for (; run_last < lines.size(); ++run_last)
+        {
+            const Line& next {lines[run_last]};
+            const gp_Pnt next_start {to_gp_pnt(next.start_point)};
+            if (next_start.Distance(run_end) > FP_EQUALS_TOLERANCE)
+                break;
+
+            const gp_Pnt next_end {next_start.Translated(gp_Vec(next.line[0], next.line[1], next.line[2]))};
+            junctions.push_back(run_end);
+            const bool collinear {std::all_of(junctions.begin(), junctions.end(), 
+                                              [&](const gp_Pnt& p)
+                                              {
+                                                  return distance_to_segment(p, run_start, next_end) <= tolerance;
+                                              })};
+            if (!collinear)
+                break;
+
+            run_end = next_end;
+        }
+
+        if (run_last == run_first + 1)
+            merged.push_back(first);
+        else
+            merged.emplace_back(first.start_point, Vec3D {run_end.X() - run_start.X(),
+                                                          run_end.Y() - run_start.Y(),
+                                                          run_end.Z() - run_start.Z()});
+        run_first = run_last;
+    }
+
+    return merged;
+}
+
+/*
+    Merges runs of arcs in which each arc starts where the previous one ends,
+        turns in the same direction, and lies on the same circle within
+        tolerance.
+
+    Notes:
+        A merged arc never sweeps more than MAX_COALESCED_ARC_ANGLE, so that it
+            is still well defined by its end points and an interior point.
+
+    Arguments:
+        arcs:      Arcs in the order in which the tool follows them.
+        tolerance: Largest difference allowed between the centers and between
+                       the radii of the circles of consecutive arcs.
+
+    Returns:
+        The merged arcs.
+*/
+std::vector<ArcOfCircle> ToolPath::coalesce_arcs(const std::vector<ArcOfCircle>& arcs,
+                                                 const double tolerance)
+{
+    // Recovers the circle that an arc lies on and the angle that it sweeps.
+    const auto circle_of = [](const ArcOfCircle& arc, double& angle)
+    {
+        const Handle(Geom_TrimmedCurve) trimmed {Handle(Geom_TrimmedCurve)::DownCast(arc.exact_representation)};
+        assert(!trimmed.IsNull());
+        angle = trimmed->LastParameter() - trimmed->FirstParameter();
+
+        const Handle(Geom_Circle) basis {Handle(Geom_Circle)::DownCast(trimmed->BasisCurve())};
+        assert(!basis.IsNull());
+        return basis->Circ();
+    };
+
+    std::vector<ArcOfCircle> merged;
+
+    std::size_t run_first {0};
+    while (run_first < arcs.size())
+    {
+        const ArcOfCircle& first {arcs[run_first]};
+        double run_angle;
+        const gp_Circ run_circle {circle_of(first, run_angle)};
+        const gp_Pnt run_start {first.representation->StartPoint()};
+        gp_Pnt run_end {first.representation->EndPoint()};
+
+        // Points where the arcs of the run meet. One of them becomes the
+        //     interior point of the merged arc.
+        std::vector<gp_Pnt> junctions;
+
+        std::size_t run_last {run_first + 1};
+        for (; run_last < arcs.size(); ++run_last)
+        {
+            const ArcOfCircle& next {arcs[run_last]};
+            if (next.representation->StartPoint().Distance(run_end) > FP_EQUALS_TOLERANCE)
+                break;
+
+            double next_angle;
+            const gp_Circ next_circle {circle_of(next, next_angle)};
+            const bool same_circle {next_circle.Location().Distance(run_circle.Location()) <= tolerance and 
+                                    std::abs(next_circle.Radius() - run_circle.Radius()) <= tolerance and
+                                    next_circle.Axis().Direction().IsEqual(run_circle.Axis().Direction(), 
+                                                                           tolerance / run_circle.Radius())};
+            if (!same_circle or run_angle + next_angle > MAX_COALESCED_ARC_ANGLE)
+                break;
+
+            junctions.push_back(run_end);
+            run_angle += next_angle;
+            run_end = next.representation->EndPoint();
+        }
+
+        if (run_last == run_first + 1)
+            merged.push_back(first);
+        else
+        {
+            // The junction farthest from both ends of the merged arc defines it
+            //     most robustly.
+            const auto interior {std::max_element(junctions.begin(), junctions.end(), 
+                                                  [&](const gp_Pnt& a, const gp_Pnt& b)
+                                                  {
+                                                      return std::min(a.Distance(run_start), a.Distance(run_end)) <
+                                                             std::min(b.Distance(run_start), b.Distance(run_end));
+                                                  })};
+            merged.emplace_back(std::pair<Point3D, Point3D> {to_point3d(run_start), to_point3d(run_end)},
+                                to_point3d(*interior));
+        }
+        run_first = run_last;
+    }
+
+    return merged;
+}
@@ -0,0 +1,126 @@
+// Standard library.
+#include <vector>
+#include <string>
+#include <ostream>
+#include <cassert>
+#include <algorithm>
+#include <stdexcept>
+
+// Third party.
+#ifdef SURFACIC_TOOLPATHS_WITH_ZLIB
+#include <zlib.h>
+#endif
+
+// Library private.
+#include "compression_p.hxx"
+#include "parallel_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Data is compressed in independent blocks of this many bytes, one block per
+//     work item.
+const std::size_t GZIP_BLOCK_BYTES {1 << 20};
+
+// zlib's default trade-off between speed and size.
+const int GZIP_LEVEL {6};
+
+/* **************************************************************************** */
+
+
+
+/*
+    Compresses data into one complete gzip member, i.e. a header, a deflate
+        stream and a trailer. A file made of several members one after the
+        other is a valid gzip file that decompresses to the concatenation of
+        the data, so members can be produced independently and in parallel.
+        This is what pigz does.
+
+    Arguments:
+        data: Start of the data to compress.
+        size: Number of bytes to compress.
+        out:  Overwritten with the member. Its capacity is reused.
+
+    Throws:
+        std::runtime_error if the library was built without zlib.
+
+    Returns:
+        None.
+*/
+void gzip_member(const char* const data,
+                 const std::size_t size,
+                 std::string& out)
+{
+#ifdef SURFACIC_TOOLPATHS_WITH_ZLIB
+    z_stream stream {};
+    // Adding 16 to the window bits asks for a gzip header and trailer.
+    const int init {deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY)};
+    assert(init == Z_OK);
+
+    out.resize(deflateBound(&stream, static_cast<uLong>(size)));
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(out.data());
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    // The output is large enough for everything, so one call finishes.
+    const int res {deflate(&stream, Z_FINISH)};
+    assert(res == Z_STREAM_END);
+
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+#else
+    (void) data;
+    (void) size;
+    (void) out;
+    throw std::runtime_error("surfacic_toolpaths was built without zlib, so gzip output is unavailable!");
+#endif
+}
+
+/*
+    Compresses data in independent blocks on a pool of workers and writes the
+        gzip members to a stream in order. The output is the same whatever the
+        number of workers.
+
+    Arguments:
+        f:       Stream to write to.
+        data:    Start of the data to compress.
+        size:    Number of bytes to compress.
+        threads: Maximum number of workers. Zero means one per hardware thread.
+
+    Returns:
+        The number of compressed bytes written.
+*/
+std::size_t write_gzip(std::ostream& f,
+                       const char* const data,
+                       const std::size_t size,
+                       const unsigned int threads)
+{
+    const std::size_t blocks {std::max<std::size_t>(1, (size + GZIP_BLOCK_BYTES - 1) / GZIP_BLOCK_BYTES)};
+
+    // Only one wave of blocks is held in memory at a time.
+    std::vector<std::string> members(std::min<std::size_t>(resolve_thread_count(threads), blocks));
+    std::size_t bytes_written {0};
+    for (std::size_t wave_start {0}; wave_start < blocks; wave_start += members.size())
+    {
+        const std::size_t wave_size {std::min(members.size(), blocks - wave_start)};
+        parallel_for(wave_size, threads,
+                     [&](const std::size_t i)
+                     {
+                         const std::size_t first {(wave_start + i) * GZIP_BLOCK_BYTES};
+                         const std::size_t last {std::min(first + GZIP_BLOCK_BYTES, size)};
+                         gzip_member(data + first, last - first, members[i]);
+                     });
+
+        for (std::size_t i {0}; i < wave_size; ++i)
+        {
+            f.write(members[i].data(), members[i].size());
+            bytes_written += members[i].size();
+        }
+    }
+
+    return bytes_written;
+}
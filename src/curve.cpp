@@ -124,6 +124,7 @@ ArcOfCircle::ArcOfCircle(const std::pair<Point3D, Point3D>& arc_endpoints,
     const Handle(Geom_TrimmedCurve) arc {arc_maker.Value()};
 
     this->representation = GeomConvert::CurveToBSplineCurve(arc);
+    this->exact_representation = arc;
 }
 
 /*
@@ -150,4 +151,5 @@ Circle::Circle(const Point3D& p1, const Point3D& p2, const Point3D& p3)
     const Handle(Geom_Circle) circle {circle_maker.Value()};
 
     this->representation = GeomConvert::CurveToBSplineCurve(circle);
+    this->exact_representation = circle;
 }
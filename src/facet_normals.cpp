@@ -0,0 +1,160 @@
+// Standard library.
+#include <cmath>
+#include <cassert>
+#include <limits>
+#include <utility>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "gp_Vec.hxx"
+#include "gp_Dir.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "facet_normals_p.hxx"
+
+/*
+    Copies the corners of every triangle of a face into a batch. The normals
+        are sized but left for geometric_normals() or vertex_average_normals()
+        to fill in.
+
+    Arguments:
+        poly_tri: Triangulation of the face.
+        reversed: Whether the face is reversed in its shape. If so, the
+                      corners are listed in the opposite order, so that the
+                      winding, and therefore the geometric normal, faces out
+                      of the solid.
+        batch:    Overwritten with the triangles of the face.
+
+    Returns:
+        None.
+*/
+void load_facets(const Handle(Poly_Triangulation)& poly_tri,
+                 const bool reversed,
+                 FacetBatch& batch)
+{
+    const std::size_t count {static_cast<std::size_t>(poly_tri->NbTriangles())};
+    for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+    {
+        batch.x[k].resize(count);
+        batch.y[k].resize(count);
+        batch.z[k].resize(count);
+    }
+    batch.nx.resize(count);
+    batch.ny.resize(count);
+    batch.nz.resize(count);
+
+    for (std::size_t i {0}; i < count; ++i)
+    {
+        int v_idx[VERTICES_PER_TRIANGLE];
+        poly_tri->Triangle(static_cast<int>(i) + 1).Get(v_idx[0], v_idx[1], v_idx[2]);
+        if (reversed)
+            std::swap(v_idx[1], v_idx[2]);
+
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            const gp_Pnt vertex {poly_tri->Node(v_idx[k])};
+            batch.x[k][i] = vertex.X();
+            batch.y[k][i] = vertex.Y();
+            batch.z[k][i] = vertex.Z();
+        }
+    }
+}
+
+/*
+    Computes the normal of every triangle of a batch from the positions of its
+        corners, following the right hand rule.
+
+    Notes:
+        The loop has no branches and no calls besides sqrt, so that compilers
+            turn it into SIMD code. See the compile options of this file in
+            CMakeLists.txt.
+        Degenerate triangles get a zero normal rather than a NaN one.
+
+    Arguments:
+        batch: Batch whose corners have been loaded by load_facets().
+
+    Returns:
+        None.
+*/
+void geometric_normals(FacetBatch& batch)
+{
+    const std::size_t count {batch.size()};
+    const double* __restrict x0 {batch.x[0].data()};
+    const double* __restrict y0 {batch.y[0].data()};
+    const double* __restrict z0 {batch.z[0].data()};
+    const double* __restrict x1 {batch.x[1].data()};
+    const double* __restrict y1 {batch.y[1].data()};
+    const double* __restrict z1 {batch.z[1].data()};
+    const double* __restrict x2 {batch.x[2].data()};
+    const double* __restrict y2 {batch.y[2].data()};
+    const double* __restrict z2 {batch.z[2].data()};
+    double* __restrict nx {batch.nx.data()};
+    double* __restrict ny {batch.ny.data()};
+    double* __restrict nz {batch.nz.data()};
+
+    // Keeps the division finite for degenerate triangles, whose cross product
+    //     is zero anyway. Too small to change any other result.
+    const double tiny {std::numeric_limits<double>::min()};
+
+    for (std::size_t i {0}; i < count; ++i)
+    {
+        const double ux {x1[i] - x0[i]};
+        const double uy {y1[i] - y0[i]};
+        const double uz {z1[i] - z0[i]};
+        const double vx {x2[i] - x0[i]};
+        const double vy {y2[i] - y0[i]};
+        const double vz {z2[i] - z0[i]};
+
+        const double cx {uy * vz - uz * vy};
+        const double cy {uz * vx - ux * vz};
+        const double cz {ux * vy - uy * vx};
+
+        const double inverse_length {1 / (std::sqrt(cx * cx + cy * cy + cz * cz) + tiny)};
+        nx[i] = cx * inverse_length;
+        ny[i] = cy * inverse_length;
+        nz[i] = cz * inverse_length;
+    }
+}
+
+/*
+    Computes the normal of every triangle of a batch by averaging the normals
+        stored at its corners, as the exporters always have.
+
+    Assumes:
+        (1) The batch was loaded from this triangulation without reversing it.
+        (2) The triangulation has normals, i.e. mesh_surface() computed them.
+
+    Arguments:
+        poly_tri: Triangulation the batch was loaded from.
+        batch:    Batch whose normals are filled in.
+
+    Returns:
+        None.
+*/
+void vertex_average_normals(const Handle(Poly_Triangulation)& poly_tri, 
+                            FacetBatch& batch)
+{
+    assert(poly_tri->HasNormals());
+
+    for (std::size_t i {0}; i < batch.size(); ++i)
+    {
+        int v1_idx, v2_idx, v3_idx;
+        poly_tri->Triangle(static_cast<int>(i) + 1).Get(v1_idx, v2_idx, v3_idx);
+
+        // Each corner normal goes through gp_Dir, and so is normalized again,
+        //     before it is summed, as the exporters always did. Skipping that
+        //     step changes the last bit of some normals.
+        gp_Vec sum {0, 0, 0};
+        for (const int v_idx : {v1_idx, v2_idx, v3_idx})
+            sum += gp_Vec {gp_Dir {gp_Vec {poly_tri->Normal(v_idx)}}};
+        const gp_Dir average {sum * (1. / VERTICES_PER_TRIANGLE)};
+
+        batch.nx[i] = average.X();
+        batch.ny[i] = average.Y();
+        batch.nz[i] = average.Z();
+    }
+}
@@ -0,0 +1,600 @@
+// Standard library.
+#include <string>
+#include <string_view>
+#include <vector>
+#include <array>
+#include <tuple>
+#include <utility>
+#include <cmath>
+#include <cstring>
+#include <charconv>
+#include <stdexcept>
+#include <functional>
+#include <numbers>
+#include <algorithm>
+
+// Third party.
+
+// OCCT.
+
+// Library public.
+#include "gcode.hxx"
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "mapped_file_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Helical arcs are sampled at least this often, in radians.
+const double HELIX_SAMPLE_ANGLE {std::numbers::pi / 4};
+
+// The modal state of a program, i.e. what carries over from block to block.
+struct GcodeState
+{
+    Point3D position;
+    // G90 and G91.
+    bool absolute {true};
+    // G90.1 and G91.1. Arc centers are relative to the start point by default.
+    bool absolute_arcs {false};
+    GcodePlane plane {GcodePlane::xy};
+    // Cleared by G80.
+    bool has_motion {false};
+    GcodeMotion motion {GcodeMotion::rapid};
+    uint64_t line {0};
+};
+
+// The words of one block that describe a move.
+struct GcodeBlock
+{
+    std::array<double, 3> axes {};
+    std::array<bool, 3> has_axes {};
+    std::array<double, 3> offsets {};
+    std::array<bool, 3> has_offsets {};
+    double radius {0};
+    bool has_radius {false};
+    double turns {1};
+};
+
+[[noreturn]] static void gcode_error(const uint64_t line, const std::string& message);
+
+static const char* read_number(const char* p,
+                               const char* const last,
+                               const char letter,
+                               const uint64_t line,
+                               double& value);
+
+static void apply_g_word(const double code, GcodeState& state);
+
+static void parse_block(const char* p,
+                        const char* const last,
+                        GcodeState& state,
+                        const std::function<void(const GcodeMove&)>& emit);
+
+static std::array<int, 3> plane_axes(const GcodePlane plane);
+
+static Point3D arc_center(const GcodeBlock& block,
+                          const GcodeState& state,
+                          const Point3D& end,
+                          const bool counterclockwise);
+
+template <class T, class... Args>
+static void emplace_segment(SegmentCompound& compound, Args&&... args);
+
+template <class T, class... Args>
+static void emplace_segment(SegmentList& segments, Args&&... args);
+
+template <class Segments>
+static void append_move(const GcodeMove& move, Segments& segments);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+[[noreturn]] static void gcode_error(const uint64_t line, const std::string& message)
+{
+    throw std::runtime_error("G-code line " + std::to_string(line) + ": " + message);
+}
+
+/*
+    Reads the number that follows the letter of a word, without copying it.
+        Blanks between the letter and the number and a leading plus sign are
+        allowed, as most controllers do.
+
+    Returns:
+        Where the text after the number starts.
+*/
+static const char* read_number(const char* p,
+                               const char* const last,
+                               const char letter,
+                               const uint64_t line,
+                               double& value)
+{
+    while (p < last and (*p == ' ' or *p == '\t'))
+        ++p;
+    if (p < last and *p == '+')
+        ++p;
+
+    const std::from_chars_result res {std::from_chars(p, last, value)};
+    if (res.ec != std::errc {})
+        gcode_error(line, std::string {"expected a number after "} + letter);
+    return res.ptr;
+}
+
+/*
+    Updates the modal state for a G word.
+
+    Notes:
+        Codes that don't change the geometry of the moves, like units, feed
+            modes, dwells, tool length offsets and work offsets, are ignored.
+        Codes whose axis words don't describe a move, and codes whose moves
+            depend on something the program doesn't hold, are refused. These
+            are G5.x splines, G10, G28, G30, G33.x, G38.x, G41, G42, G52,
+            G53, the G73, G74, G76 and G8x canned cycles, and G92.
+*/
+static void apply_g_word(const double code, GcodeState& state)
+{
+    // Codes like G90.1 have one decimal.
+    const long tenths {std::lround(code * 10)};
+    switch (tenths)
+    {
+    case 0:
+        state.has_motion = true;
+        state.motion = GcodeMotion::rapid;
+        break;
+    case 10:
+        state.has_motion = true;
+        state.motion = GcodeMotion::linear;
+        break;
+    case 20:
+        state.has_motion = true;
+        state.motion = GcodeMotion::clockwise_arc;
+        break;
+    case 30:
+        state.has_motion = true;
+        state.motion = GcodeMotion::counterclockwise_arc;
+        break;
+    case 170:
+        state.plane = GcodePlane::xy;
+        break;
+    case 180:
+        state.plane = GcodePlane::zx;
+        break;
+    case 190:
+        state.plane = GcodePlane::yz;
+        break;
+    case 800:
+        state.has_motion = false;
+        break;
+    case 900:
+        state.absolute = true;
+        break;
+    case 910:
+        state.absolute = false;
+        break;
+    case 901:
+        state.absolute_arcs = true;
+        break;
+    case 911:
+        state.absolute_arcs = false;
+        break;
+    case 50: case 51: case 52: case 53:
+    case 100: case 280: case 300: case 330: case 331: case 380: case 382: case 383: case 384: case 385:
+    case 410: case 420: case 520: case 530:
+    case 730: case 740: case 760:
+    case 810: case 820: case 830: case 840: case 850: case 860: case 870: case 880: case 890:
+    case 920: case 921: case 922: case 923:
+        gcode_error(state.line, "G" + std::to_string(tenths / 10) +
+                                (tenths % 10 == 0 ? "" : "." + std::to_string(tenths % 10)) +
+                                " is not supported");
+    default:
+        break;
+    }
+}
+
+/*
+    Parses one block, i.e. one line of the program, updates the modal state
+        and emits the move the block describes, if any.
+*/
+static void parse_block(const char* p,
+                        const char* const last,
+                        GcodeState& state,
+                        const std::function<void(const GcodeMove&)>& emit)
+{
+    GcodeBlock block;
+    bool arc_words {false};
+
+    while (p < last)
+    {
+        const char c {*p};
+        if (c == ' ' or c == '\t' or c == '\r' or c == '%' or c == '/')
+        {
+            // Blanks, program delimiters and block delete marks.
+            ++p;
+            continue;
+        }
+        if (c == ';')
+            break;
+        if (c == '(')
+        {
+            const char* const close {static_cast<const char*>(std::memchr(p, ')', last - p))};
+            if (!close)
+                gcode_error(state.line, "unclosed comment");
+            p = close + 1;
+            continue;
+        }
+
+        const char letter {static_cast<char>(c >= 'a' and c <= 'z' ? c - 'a' + 'A' : c)};
+        if (letter < 'A' or letter > 'Z')
+            gcode_error(state.line, std::string {"unexpected character "} + c);
+
+        double value;
+        p = read_number(p + 1, last, letter, state.line, value);
+
+        switch (letter)
+        {
+        case 'G':
+            apply_g_word(value, state);
+            break;
+        case 'X': case 'Y': case 'Z':
+            block.axes[letter - 'X'] = value;
+            block.has_axes[letter - 'X'] = true;
+            break;
+        case 'I': case 'J': case 'K':
+            block.offsets[letter - 'I'] = value;
+            block.has_offsets[letter - 'I'] = true;
+            arc_words = true;
+            break;
+        case 'R':
+            block.radius = value;
+            block.has_radius = true;
+            arc_words = true;
+            break;
+        case 'P':
+            block.turns = value;
+            break;
+        case 'A': case 'B': case 'C': case 'U': case 'V': case 'W':
+            gcode_error(state.line, std::string {"the "} + letter + " axis is not supported");
+        default:
+            // Line numbers, feeds, speeds, tools and so on.
+            break;
+        }
+    }
+
+    const bool has_axes {block.has_axes[0] or block.has_axes[1] or block.has_axes[2]};
+    const bool arc {state.has_motion and (state.motion == GcodeMotion::clockwise_arc or
+                                          state.motion == GcodeMotion::counterclockwise_arc)};
+    // An arc without axis words is a full circle around the current position.
+    if (!has_axes and !(arc and arc_words))
+        return;
+    if (!state.has_motion)
+        gcode_error(state.line, "axis words without a motion mode");
+
+    Point3D end {state.position};
+    for (int i {0}; i < 3; ++i)
+        if (block.has_axes[i])
+            end[i] = state.absolute ? block.axes[i] : state.position[i] + block.axes[i];
+
+    GcodeMove move {state.motion, state.position, end, state.position, state.plane, 1, state.line};
+    if (arc)
+    {
+        if (block.turns < 1 or block.turns != std::floor(block.turns))
+            gcode_error(state.line, "the number of turns must be a positive integer");
+        move.turns = static_cast<uint32_t>(block.turns);
+        move.center = arc_center(block, state, end, state.motion == GcodeMotion::counterclockwise_arc);
+    }
+
+    emit(move);
+    state.position = end;
+}
+
+/*
+    The axes of a plane, in the order (first in-plane axis, second in-plane
+        axis, normal), as indices into a point.
+*/
+static std::array<int, 3> plane_axes(const GcodePlane plane)
+{
+    switch (plane)
+    {
+    case GcodePlane::zx:
+        return {2, 0, 1};
+    case GcodePlane::yz:
+        return {1, 2, 0};
+    case GcodePlane::xy:
+    default:
+        return {0, 1, 2};
+    }
+}
+
+/*
+    Finds the center of an arc, either from the I, J and K words or from the R
+        word. A positive radius selects the arc that is shorter than a half
+        circle, a negative radius the longer one.
+*/
+static Point3D arc_center(const GcodeBlock& block,
+                          const GcodeState& state,
+                          const Point3D& end,
+                          const bool counterclockwise)
+{
+    const auto [u, v, w] = plane_axes(state.plane);
+    const Point3D& start {state.position};
+    Point3D center {start};
+
+    if (!block.has_radius)
+    {
+        if (!block.has_offsets[u] and !block.has_offsets[v])
+            gcode_error(state.line, "arc without a center or a radius");
+        for (const int i : {u, v})
+        {
+            if (state.absolute_arcs)
+                center[i] = block.has_offsets[i] ? block.offsets[i] : start[i];
+            else
+                center[i] = start[i] + block.offsets[i];
+        }
+        return center;
+    }
+
+    const double du {end[u] - start[u]};
+    const double dv {end[v] - start[v]};
+    const double chord {std::hypot(du, dv)};
+    if (compare_fp(chord, 0))
+        gcode_error(state.line, "a full circle can't be given by its radius");
+    if (chord > 2 * std::abs(block.radius) + FP_EQUALS_TOLERANCE)
+        gcode_error(state.line, "the radius is too small for the distance between the end points");
+
+    // Distance from the middle of the chord to the center, along the normal
+    //     of the chord on its left side.
+    const double half_chord {chord / 2};
+    const double offset {std::sqrt(std::max(0.0, block.radius * block.radius - half_chord * half_chord))};
+    const double side {(counterclockwise ? 1.0 : -1.0) * (block.radius > 0 ? 1.0 : -1.0)};
+    center[u] = start[u] + du / 2 - side * offset * dv / chord;
+    center[v] = start[v] + dv / 2 + side * offset * du / chord;
+    return center;
+}
+
+/*
+    Adds a segment of kind T, constructed from the arguments, at the end of a
+        compound or a list.
+*/
+template <class T, class... Args>
+static void emplace_segment(SegmentCompound& compound, Args&&... args)
+{
+    std::get<std::vector<T>>(compound).emplace_back(std::forward<Args>(args)...);
+}
+
+template <class T, class... Args>
+static void emplace_segment(SegmentList& segments, Args&&... args)
+{
+    segments.emplace_back<T>(std::forward<Args>(args)...);
+}
+
+/*
+    See append_gcode_move(). Shared by its overloads.
+*/
+template <class Segments>
+static void append_move(const GcodeMove& move, Segments& segments)
+{
+    const Point3D& start {move.start};
+    const Point3D& end {move.end};
+
+    if (move.motion == GcodeMotion::rapid or move.motion == GcodeMotion::linear)
+    {
+        const Vec3D path {end[0] - start[0], end[1] - start[1], end[2] - start[2]};
+        if (compare_fp(path[0], 0) and compare_fp(path[1], 0) and compare_fp(path[2], 0))
+            return;
+        emplace_segment<Line>(segments, start, path);
+        return;
+    }
+
+    const auto [u, v, w] = plane_axes(move.plane);
+    const Point3D& center {move.center};
+    const double start_radius {std::hypot(start[u] - center[u], start[v] - center[v])};
+    const double end_radius {std::hypot(end[u] - center[u], end[v] - center[v])};
+    if (compare_fp(start_radius, 0))
+        gcode_error(move.line, "arc of zero radius");
+
+    // The angle swept, counted positive in the direction of the arc.
+    const double direction {move.motion == GcodeMotion::counterclockwise_arc ? 1.0 : -1.0};
+    const double start_angle {std::atan2(start[v] - center[v], start[u] - center[u])};
+    const double end_angle {std::atan2(end[v] - center[v], end[u] - center[u])};
+    double sweep {direction * (end_angle - start_angle)};
+    if (compare_fp(start[u], end[u]) and compare_fp(start[v], end[v]))
+        sweep = 2 * std::numbers::pi;
+    else if (sweep < 0)
+        sweep += 2 * std::numbers::pi;
+    sweep += 2 * std::numbers::pi * (move.turns - 1);
+
+    const double lift {end[w] - start[w]};
+    const auto point = [&](const double t) -> Point3D
+    {
+        const double angle {start_angle + direction * sweep * t};
+        const double radius {start_radius + (end_radius - start_radius) * t};
+        Point3D p {};
+        p[u] = center[u] + radius * std::cos(angle);
+        p[v] = center[v] + radius * std::sin(angle);
+        p[w] = start[w] + lift * t;
+        return p;
+    };
+
+    if (compare_fp(lift, 0))
+    {
+        if (sweep < 2 * std::numbers::pi - FP_EQUALS_TOLERANCE)
+            emplace_segment<ArcOfCircle>(segments, std::pair {start, end}, point(.5));
+        else
+            emplace_segment<Circle>(segments, point(0), point(1.0 / 3), point(2.0 / 3));
+        return;
+    }
+
+    const std::size_t intervals {static_cast<std::size_t>(std::ceil(sweep / HELIX_SAMPLE_ANGLE))};
+    std::vector<Point3D> samples;
+    std::vector<std::pair<uint64_t, Vec3D>> tangents;
+    for (std::size_t i {0}; i <= intervals; ++i)
+    {
+        const double t {static_cast<double>(i) / intervals};
+        const double angle {start_angle + direction * sweep * t};
+        const double radius {start_radius + (end_radius - start_radius) * t};
+        Vec3D tangent {};
+        tangent[u] = -direction * sweep * radius * std::sin(angle) + (end_radius - start_radius) * std::cos(angle);
+        tangent[v] = direction * sweep * radius * std::cos(angle) + (end_radius - start_radius) * std::sin(angle);
+        tangent[w] = lift;
+        samples.push_back(i == intervals ? end : point(t));
+        tangents.emplace_back(i, tangent);
+    }
+    emplace_segment<InterpolatedCurve>(segments, samples, tangents);
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    Parses a G-code program and hands every move to a callback, in program
+        order, as soon as it is read. Nothing but the modal state is kept, so
+        memory use doesn't depend on the size of the program.
+
+    Notes:
+        Understood: G0, G1, G2, G3, G17, G18, G19, G80, G90, G91, G90.1,
+            G91.1, the X, Y, Z, I, J, K, R and P words, comments in
+            parentheses or after a semicolon, and modal motion (axis words
+            alone repeat the last motion).
+        Numbers are parsed in place with std::from_chars.
+        See apply_g_word() for what is refused.
+
+    Arguments:
+        program:          The text of the program.
+        emit:             Called with every move.
+        initial_position: Where the tool is before the first move.
+
+    Throws:
+        std::runtime_error with the line number if the program is malformed
+            or uses something that isn't supported.
+
+    Returns:
+        None.
+*/
+void parse_gcode(std::string_view program,
+                 const std::function<void(const GcodeMove&)>& emit,
+                 const Point3D& initial_position)
+{
+    GcodeState state;
+    state.position = initial_position;
+
+    const char* p {program.data()};
+    const char* const last {p + program.size()};
+    while (p < last)
+    {
+        const char* eol {static_cast<const char*>(std::memchr(p, '\n', last - p))};
+        if (!eol)
+            eol = last;
+
+        ++state.line;
+        parse_block(p, eol, state, emit);
+        p = eol + 1;
+    }
+}
+
+/*
+    Parses a G-code program stored in a file. See parse_gcode().
+
+    Notes:
+        The file is mapped into memory rather than read, so the text is
+            never copied and the kernel reads ahead while the program is
+            parsed.
+
+    Throws:
+        std::runtime_error if the file can't be read, and as parse_gcode().
+*/
+void parse_gcode_file(const std::string& filepath,
+                      const std::function<void(const GcodeMove&)>& emit,
+                      const Point3D& initial_position)
+{
+    const MappedFile file {filepath};
+    parse_gcode({file.data(), file.size()}, emit, initial_position);
+}
+
+/*
+    Converts a move into the segment that the library sweeps, and adds it to a
+        compound. Moves that go nowhere are dropped.
+
+    Notes:
+        Planar arcs become arcs of circles, and planar arcs that go all the way
+            around become circles. Helical arcs become curves interpolated
+            through samples of the helix, with exact tangents.
+        The radius at the end of an arc may differ a little from the radius
+            at its start, as controllers allow. The difference is spread
+            evenly along the arc.
+
+    Arguments:
+        move:     A move emitted by parse_gcode().
+        compound: Receives the segment.
+
+    Returns:
+        None.
+*/
+void append_gcode_move(const GcodeMove& move, SegmentCompound& compound)
+{
+    append_move(move, compound);
+}
+
+/*
+    See append_gcode_move(). The segment goes at the end of the list, so moves
+        appended in the order they are emitted keep the order of the program.
+*/
+void append_gcode_move(const GcodeMove& move, SegmentList& segments)
+{
+    append_move(move, segments);
+}
+
+/*
+    Parses a G-code program into the segments of a toolpath. See parse_gcode()
+        and append_gcode_move().
+
+    Arguments:
+        program:        The text of the program.
+        include_rapids: Also sweep the rapid moves. They usually happen out of
+                            the material, so they are left out by default.
+
+    Returns:
+        The segments, ready to be handed to ToolPath::ToolPath().
+*/
+SegmentCompound read_gcode(std::string_view program,
+                           const bool include_rapids)
+{
+    SegmentCompound compound;
+    parse_gcode(program,
+                [&compound, include_rapids](const GcodeMove& move)
+                {
+                    if (include_rapids or move.motion != GcodeMotion::rapid)
+                        append_gcode_move(move, compound);
+                });
+    return compound;
+}
+
+/*
+    Parses a G-code program stored in a file into the segments of a toolpath.
+        See read_gcode() and parse_gcode_file().
+*/
+SegmentCompound read_gcode_file(const std::string& filepath,
+                                const bool include_rapids)
+{
+    SegmentCompound compound;
+    parse_gcode_file(filepath,
+                     [&compound, include_rapids](const GcodeMove& move)
+                     {
+                         if (include_rapids or move.motion != GcodeMotion::rapid)
+                             append_gcode_move(move, compound);
+                     });
+    return compound;
+}
@@ -0,0 +1,212 @@
+// Standard library.
+#include <vector>
+#include <string>
+#include <cassert>
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+
+// Third party.
+
+// OCCT.
+
+// Library public.
+#include "toolpath.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "mesh_export_p.hxx"
+#include "instrumentation_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// See https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html#binary-gltf-layout
+const uint32_t GLB_MAGIC {0x46546C67};
+const uint32_t GLB_VERSION {2};
+const uint32_t GLB_JSON_CHUNK {0x4E4F534A};
+const uint32_t GLB_BIN_CHUNK {0x004E4942};
+const std::size_t GLB_HEADER_BYTES {12};
+const std::size_t GLB_CHUNK_HEADER_BYTES {8};
+
+// Values of the glTF enumerations that are used.
+const int GLTF_FLOAT {5126};
+const int GLTF_UNSIGNED_INT {5125};
+const int GLTF_ARRAY_BUFFER {34962};
+const int GLTF_ELEMENT_ARRAY_BUFFER {34963};
+const int GLTF_TRIANGLES {4};
+
+static std::size_t padded_to_four(const std::size_t bytes);
+
+static void append_float(std::string& out, const float value);
+
+static void append_vec3(std::string& out, const std::array<float, 3>& v);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+/*
+    Chunks and the data in them must start on 4 byte boundaries.
+*/
+static std::size_t padded_to_four(const std::size_t bytes)
+{
+    return (bytes + 3) / 4 * 4;
+}
+
+/*
+    Appends the shortest text that reads back as exactly the same float, so
+        that accessor bounds match the stored data bit for bit.
+*/
+static void append_float(std::string& out, const float value)
+{
+    char digits[32];
+    const std::to_chars_result res {std::to_chars(digits, digits + sizeof(digits), value)};
+    assert(res.ec == std::errc {});
+    out.append(digits, res.ptr);
+}
+
+static void append_vec3(std::string& out, const std::array<float, 3>& v)
+{
+    out += '[';
+    append_float(out, v[0]);
+    out += ',';
+    append_float(out, v[1]);
+    out += ',';
+    append_float(out, v[2]);
+    out += ']';
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    Writes the meshed toolpath to a binary glTF (.glb) file. Even if the file
+        already exists, it is completely overwritten. The file holds a single
+        mesh with welded vertices, so consumers can hand the binary chunk
+        straight to the GPU without parsing anything.
+    See https://registry.khronos.org/glTF/specs/2.0/glTF-2.0.html for the format.
+
+    Notes:
+        The binary chunk holds the float32 positions, then the float32 normals
+            if requested, then the uint32 triangle indices.
+        Normals are per vertex. See vertex_normals() for how they are computed.
+        The file is written straight into a mapping of the file or into a
+            buffer written in a single call. See BuildOptions::mapped_output
+            and BuildOptions::output_compression.
+
+    Assumes:
+        (1) The caller is OK with the file being overwritten if it already exists.
+        (2) The toolpath has already been meshed in a satisfactory way, with at
+                least one triangle. glTF doesn't allow empty accessors.
+
+    Arguments:
+        filepath:       Absolute path to the file to write to.
+        normals:        Include vertex normals.
+        weld_tolerance: Vertices closer than this are merged. Must be positive.
+
+    Returns:
+        None.
+*/
+void ToolPath::shape_to_glb(const std::string filepath,
+                            const bool normals,
+                            const double weld_tolerance) const
+{
+    const ScopedSpan span {this->options.instrumentation, "write glb"};
+
+    const IndexedMesh mesh {weld_triangulations(collect_triangulations(this->toolpath_shape_union), weld_tolerance)};
+    assert(mesh.triangle_count() > 0);
+
+    const std::size_t vertex_bytes {3 * sizeof(float) * mesh.vertex_count()};
+    const std::size_t index_bytes {sizeof(uint32_t) * mesh.indices.size()};
+    const std::size_t normal_offset {vertex_bytes};
+    const std::size_t index_offset {normals ? 2 * vertex_bytes : vertex_bytes};
+    const std::size_t bin_bytes {index_offset + index_bytes};
+
+    // Bounds of the positions once they are rounded to float32, i.e. of the
+    //     stored values.
+    std::array<float, 3> min {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+    std::array<float, 3> max {std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()};
+    for (std::size_t i {0}; i < mesh.positions.size(); ++i)
+    {
+        const float coordinate {static_cast<float>(mesh.positions[i])};
+        min[i % 3] = std::min(min[i % 3], coordinate);
+        max[i % 3] = std::max(max[i % 3], coordinate);
+    }
+
+    // The JSON chunk.
+    const std::string vertex_count {std::to_string(mesh.vertex_count())};
+    std::string json;
+    json += R"({"asset":{"version":"2.0","generator":"surfacic_toolpaths"},)";
+    json += R"("scene":0,"scenes":[{"nodes":[0]}],"nodes":[{"mesh":0}],)";
+    json += R"("meshes":[{"primitives":[{"attributes":{"POSITION":0)";
+    if (normals)
+        json += R"(,"NORMAL":1)";
+    json += R"(},"indices":)" + std::to_string(normals ? 2 : 1) + R"(,"mode":)" + std::to_string(GLTF_TRIANGLES) + "}]}],";
+    json += R"("buffers":[{"byteLength":)" + std::to_string(bin_bytes) + "}],";
+
+    json += R"("bufferViews":[)";
+    json += R"({"buffer":0,"byteOffset":0,"byteLength":)" + std::to_string(vertex_bytes) + R"(,"target":)" + std::to_string(GLTF_ARRAY_BUFFER) + "},";
+    if (normals)
+        json += R"({"buffer":0,"byteOffset":)" + std::to_string(normal_offset) + R"(,"byteLength":)" + std::to_string(vertex_bytes) + R"(,"target":)" + std::to_string(GLTF_ARRAY_BUFFER) + "},";
+    json += R"({"buffer":0,"byteOffset":)" + std::to_string(index_offset) + R"(,"byteLength":)" + std::to_string(index_bytes) + R"(,"target":)" + std::to_string(GLTF_ELEMENT_ARRAY_BUFFER) + "}],";
+
+    json += R"("accessors":[)";
+    json += R"({"bufferView":0,"componentType":)" + std::to_string(GLTF_FLOAT) + R"(,"count":)" + vertex_count + R"(,"type":"VEC3","min":)";
+    append_vec3(json, min);
+    json += R"(,"max":)";
+    append_vec3(json, max);
+    json += "},";
+    if (normals)
+        json += R"({"bufferView":1,"componentType":)" + std::to_string(GLTF_FLOAT) + R"(,"count":)" + vertex_count + R"(,"type":"VEC3"},)";
+    json += R"({"bufferView":)" + std::to_string(normals ? 2 : 1) + R"(,"componentType":)" + std::to_string(GLTF_UNSIGNED_INT) +
+            R"(,"count":)" + std::to_string(mesh.indices.size()) + R"(,"type":"SCALAR"}]})";
+
+    // The JSON chunk is padded with spaces. The binary chunk only holds 4 byte
+    //     values, so it needs no padding.
+    json.resize(padded_to_four(json.size()), ' ');
+    assert(bin_bytes == padded_to_four(bin_bytes));
+
+    const std::size_t size {GLB_HEADER_BYTES + 2 * GLB_CHUNK_HEADER_BYTES + json.size() + bin_bytes};
+
+    const auto fill = [&](char* const file)
+    {
+        char* out {put_uint32(file, GLB_MAGIC)};
+        out = put_uint32(out, GLB_VERSION);
+        out = put_uint32(out, static_cast<uint32_t>(size));
+        out = put_uint32(out, static_cast<uint32_t>(json.size()));
+        out = put_uint32(out, GLB_JSON_CHUNK);
+        out = std::copy(json.begin(), json.end(), out);
+        out = put_uint32(out, static_cast<uint32_t>(bin_bytes));
+        out = put_uint32(out, GLB_BIN_CHUNK);
+
+        for (const double coordinate : mesh.positions)
+            out = put_float32(out, static_cast<float>(coordinate));
+        if (normals)
+            for (const double component : vertex_normals(mesh))
+                out = put_float32(out, static_cast<float>(component));
+        for (const uint32_t index : mesh.indices)
+            out = put_uint32(out, index);
+        assert(out == file + size);
+    };
+    const std::size_t bytes_written {write_output(filepath, size, this->options, fill)};
+
+    if (this->options.instrumentation)
+    {
+        this->options.instrumentation->add_to_counter("welded vertices", mesh.vertex_count());
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+    }
+}
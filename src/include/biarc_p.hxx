@@ -0,0 +1,27 @@
+#pragma once
+
+// Standard library.
+#include <vector>
+
+// Third party.
+#include "gp_Pnt.hxx"
+#include "Geom_Curve.hxx"
+
+// One piece of a path made of straight lines and arcs of circles.
+struct ArcPiece
+{
+    gp_Pnt start;
+    gp_Pnt end;
+    // A point on the arc strictly between start and end. Unused when straight.
+    gp_Pnt interior;
+    bool straight;
+};
+
+std::vector<ArcPiece> fit_biarcs(const Handle(Geom_Curve)& curve,
+                                 const std::vector<double>& breaks,
+                                 const double tolerance,
+                                 double& max_error);
+
+std::vector<ArcPiece> fit_biarcs(const std::vector<gp_Pnt>& polyline,
+                                 const double tolerance,
+                                 double& max_error);
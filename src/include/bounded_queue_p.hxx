@@ -0,0 +1,98 @@
+#pragma once
+
+// Standard library.
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <optional>
+#include <cstddef>
+#include <cassert>
+
+/*
+    A first in, first out queue between the stages of a pipeline. Producers
+        wait while it is full, so a fast stage can't run ahead of a slow one
+        by more than the capacity of the queue.
+
+    Notes:
+        close() is called once every producer is done. Consumers then drain
+            what is left, after which pop() returns nothing.
+        abort() is called when a stage fails. Items still queued are dropped,
+            and every producer and consumer stops waiting.
+*/
+template <class T>
+class BoundedQueue
+{
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
+    std::deque<T> items;
+    const std::size_t capacity;
+    bool closed {false};
+    bool aborted {false};
+
+public:
+    explicit BoundedQueue(const std::size_t capacity) : capacity(capacity)
+    {
+        assert(capacity > 0);
+    }
+
+    /*
+        Adds an item, waiting for room if the queue is full.
+
+        Returns:
+            False if the queue was aborted, in which case the item is dropped.
+    */
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock {this->mutex};
+        this->not_full.wait(lock, [this]() { return this->aborted or this->items.size() < this->capacity; });
+        if (this->aborted)
+            return false;
+
+        assert(!this->closed);
+        this->items.push_back(std::move(item));
+        lock.unlock();
+        this->not_empty.notify_one();
+        return true;
+    }
+
+    /*
+        Removes the oldest item, waiting for one if the queue is empty.
+
+        Returns:
+            Nothing once the queue is closed and drained, or aborted.
+    */
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock {this->mutex};
+        this->not_empty.wait(lock, [this]() { return this->aborted or this->closed or !this->items.empty(); });
+        if (this->aborted or this->items.empty())
+            return std::nullopt;
+
+        T item {std::move(this->items.front())};
+        this->items.pop_front();
+        lock.unlock();
+        this->not_full.notify_one();
+        return item;
+    }
+
+    void close()
+    {
+        {
+            const std::lock_guard<std::mutex> lock {this->mutex};
+            this->closed = true;
+        }
+        this->not_empty.notify_all();
+    }
+
+    void abort()
+    {
+        {
+            const std::lock_guard<std::mutex> lock {this->mutex};
+            this->aborted = true;
+            this->items.clear();
+        }
+        this->not_full.notify_all();
+        this->not_empty.notify_all();
+    }
+};
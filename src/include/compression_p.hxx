@@ -0,0 +1,15 @@
+#pragma once
+
+// Standard library.
+#include <string>
+#include <ostream>
+#include <cstddef>
+
+void gzip_member(const char* const data,
+                 const std::size_t size,
+                 std::string& out);
+
+std::size_t write_gzip(std::ostream& f,
+                       const char* const data,
+                       const std::size_t size,
+                       const unsigned int threads);
@@ -0,0 +1,38 @@
+#pragma once
+
+// Standard library.
+#include <array>
+#include <vector>
+#include <cstddef>
+
+// Third party.
+#include "Poly_Triangulation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+
+// The triangles of one face, stored as a structure of arrays so that the
+//     normal kernel runs over contiguous coordinates. Meant to be reused from
+//     face to face; the arrays only grow.
+struct FacetBatch
+{
+    // Corner k of triangle i is (x[k][i], y[k][i], z[k][i]).
+    std::array<std::vector<double>, VERTICES_PER_TRIANGLE> x;
+    std::array<std::vector<double>, VERTICES_PER_TRIANGLE> y;
+    std::array<std::vector<double>, VERTICES_PER_TRIANGLE> z;
+    // Unit normal of triangle i.
+    std::vector<double> nx;
+    std::vector<double> ny;
+    std::vector<double> nz;
+
+    std::size_t size() const { return this->nx.size(); }
+};
+
+void load_facets(const Handle(Poly_Triangulation)& poly_tri,
+                 const bool reversed,
+                 FacetBatch& batch);
+
+void geometric_normals(FacetBatch& batch);
+
+void vertex_average_normals(const Handle(Poly_Triangulation)& poly_tri, 
+                            FacetBatch& batch);
@@ -0,0 +1,38 @@
+#pragma once
+
+// Standard library.
+#include <cstdint>
+
+// Library public.
+#include "instrumentation.hxx"
+
+/*
+    Records the wall time between its construction and its destruction as a 
+        span. Does nothing at all when the instrumentation is null.
+*/
+class ScopedSpan
+{
+    Instrumentation* const instrumentation;
+    const char* const name;
+    const int64_t segment;
+    Instrumentation::Clock::time_point start;
+
+public:
+    ScopedSpan(Instrumentation* const instrumentation, 
+               const char* const name,
+               const int64_t segment=-1)
+        : instrumentation(instrumentation), name(name), segment(segment)
+    {
+        if (this->instrumentation)
+            this->start = Instrumentation::Clock::now();
+    }
+
+    ~ScopedSpan()
+    {
+        if (this->instrumentation)
+            this->instrumentation->record_span(this->name, this->start, Instrumentation::Clock::now(), this->segment);
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+};
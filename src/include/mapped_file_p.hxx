@@ -0,0 +1,31 @@
+#pragma once
+
+// Standard library.
+#include <string>
+#include <cstddef>
+
+/*
+    A file mapped into memory. Either a file of a fixed size, created or
+        truncated on construction and mapped for writing, or an existing file
+        mapped for reading only.
+    Whatever is written through data() of a writable mapping ends up in the
+        file once the mapping is destroyed. Writing through data() of a
+        read-only mapping crashes.
+*/
+class MappedFile
+{
+    int descriptor {-1};
+    char* address {nullptr};
+    std::size_t length {0};
+
+public:
+    MappedFile(const std::string& filepath, const std::size_t length);
+    explicit MappedFile(const std::string& filepath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() const { return this->address; }
+    std::size_t size() const { return this->length; }
+};
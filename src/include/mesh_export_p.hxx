@@ -0,0 +1,89 @@
+#pragma once
+
+// Standard library.
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+// Third party.
+#include "TopoDS_Shape.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+
+// A triangulated face of the toolpath shape.
+struct FaceTriangulation
+{
+    Handle(Poly_Triangulation) poly_tri;
+    bool reversed;
+    // Position of the face among all faces of the shape, triangulated or not.
+    uint32_t face_id;
+};
+
+// A triangle mesh in which coincident vertices are stored once.
+struct IndexedMesh
+{
+    // Vertex i is (positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]).
+    std::vector<double> positions;
+    // Triangle i is (indices[3 * i], indices[3 * i + 1], indices[3 * i + 2]),
+    //     wound counterclockwise when seen from outside of the solid.
+    std::vector<uint32_t> indices;
+    // Triangle i comes from the face with face_id face_ids[i].
+    std::vector<uint32_t> face_ids;
+
+    std::size_t vertex_count() const { return this->positions.size() / 3; }
+    std::size_t triangle_count() const { return this->indices.size() / 3; }
+};
+
+// The arrays behind a MeshView. Made empty by mesh_surface(), and filled
+//     once, under built, by the first call to mesh_view().
+struct MeshBuffers
+{
+    std::once_flag built;
+    IndexedMesh mesh;
+    std::vector<double> normals;
+};
+
+std::vector<FaceTriangulation> collect_triangulations(const TopoDS_Shape& shape);
+
+IndexedMesh weld_triangulations(const std::vector<FaceTriangulation>& triangulations,
+                                const double tolerance);
+
+std::size_t close_t_junctions(IndexedMesh& mesh, const double tolerance);
+
+std::vector<double> vertex_normals(const IndexedMesh& mesh);
+
+std::size_t write_output(const std::string& filepath,
+                         const std::size_t size,
+                         const BuildOptions& options,
+                         const std::function<void(char*)>& fill);
+
+std::size_t write_ply(const std::string& filepath,
+                      const IndexedMesh& mesh,
+                      const BuildOptions& options);
+
+std::size_t write_text(const std::string& filepath,
+                       const std::string& text,
+                       const BuildOptions& options);
+
+std::string stl_header(const std::string& solid_name,
+                       const StlFormat format,
+                       const uint32_t triangles=0);
+
+std::string stl_trailer(const std::string& solid_name, const StlFormat format);
+
+void append_stl_facets(std::string& out,
+                       const FaceTriangulation& face,
+                       const StlFormat format,
+                       const FacetNormals normals);
+
+void append_number(std::string& out, const double value);
+
+char* put_uint16(char* out, const uint16_t value);
+
+char* put_uint32(char* out, const uint32_t value);
+
+char* put_float32(char* out, const float value);
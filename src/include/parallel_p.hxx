@@ -0,0 +1,91 @@
+#pragma once
+
+// Standard library.
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+    Resolves a requested worker count. A request of zero means "use every
+        hardware thread".
+*/
+inline unsigned int resolve_thread_count(const unsigned int requested)
+{
+    if (requested != 0)
+        return requested;
+
+    const unsigned int hardware {std::thread::hardware_concurrency()};
+    return hardware == 0 ? 1 : hardware;
+}
+
+/*
+    Calls f(i) for every i in [0, count) on a pool of worker threads.
+
+    Notes:
+        Indices are handed out one at a time, so work items of uneven cost
+            balance themselves across the workers.
+        The calling thread is one of the workers.
+        If f throws, the remaining indices are abandoned and the first exception
+            is rethrown on the calling thread after every worker has stopped.
+
+    Arguments:
+        count:   Number of work items.
+        threads: Maximum number of workers. Zero means one per hardware thread.
+        f:       Callable invoked as f(std::size_t). Must be safe to call
+                     concurrently for distinct indices.
+
+    Returns:
+        None.
+*/
+template <class F>
+void parallel_for(const std::size_t count, const unsigned int threads, F&& f)
+{
+    const std::size_t workers {std::min<std::size_t>(resolve_thread_count(threads), count)};
+    if (workers <= 1)
+    {
+        for (std::size_t i {0}; i < count; ++i)
+            f(i);
+        return;
+    }
+
+    std::atomic<std::size_t> next {0};
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto work = [&]()
+    {
+        while (true)
+        {
+            const std::size_t i {next.fetch_add(1)};
+            if (i >= count)
+                return;
+
+            try
+            {
+                f(i);
+            }
+            catch (...)
+            {
+                const std::lock_guard<std::mutex> lock {error_mutex};
+                if (!error)
+                    error = std::current_exception();
+                next.store(count);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    pool.reserve(workers - 1);
+    for (std::size_t w {1}; w < workers; ++w)
+        pool.emplace_back(work);
+    work();
+    for (std::thread& t : pool)
+        t.join();
+
+    if (error)
+        std::rethrow_exception(error);
+}
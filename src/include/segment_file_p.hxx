@@ -0,0 +1,97 @@
+#pragma once
+
+// Standard library.
+#include <array>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
+
+// Library public.
+#include "geometric_primitives.hxx"
+
+/*
+    Layout of the segment files read and written by SegmentFile. A file is a
+        header, one fixed size record per segment and a side table of doubles
+        that holds the curve representations. Everything is little-endian and
+        naturally aligned, so the file is used in place once mapped.
+*/
+
+// The first bytes of every segment file.
+const std::array<char, 8> SEGMENT_FILE_MAGIC {'T', 'P', 'S', 'E', 'G', 'M', 'T', '\n'};
+
+// The kind of a record. Numbered like the members of SegmentCompound.
+enum class SegmentKind : uint32_t
+{
+    line,
+    arc,
+    interpolated,
+    circle
+};
+
+// Record flags.
+const uint32_t SEGMENT_RATIONAL {1 << 0};
+const uint32_t SEGMENT_PERIODIC {1 << 1};
+
+struct SegmentFileHeader
+{
+    std::array<char, 8> magic;
+    uint32_t version;
+    // Size of a SegmentRecord, to catch files written by a different layout.
+    uint32_t record_bytes;
+    uint64_t segment_count;
+    // Number of doubles in the side table.
+    uint64_t side_count;
+    // Number of records of each SegmentKind.
+    std::array<uint64_t, 4> kind_counts;
+    // Bounding box of the line end points and of the curve poles, which 
+    //     enclose the curves.
+    Point3D bounds_min;
+    Point3D bounds_max;
+};
+
+/*
+    One segment. Lines are complete in the record. Curves keep their B-spline
+        representation in the side table, starting at side_offset:
+            3 * pole_count pole coordinates,
+            pole_count weights, for rational curves only,
+            knot_count knots,
+            knot_count knot multiplicities.
+        Arcs and circles follow with their exact circle:
+            3 center coordinates, 3 axis components, 3 x axis components,
+            the radius,
+            and, for arcs only, the first and last parameters on the circle.
+*/
+struct SegmentRecord
+{
+    SegmentKind kind;
+    uint32_t flags;
+    // Lines: the start point. Curves: the start point of the B-spline.
+    Point3D first;
+    // Lines: the line vector. Curves: the end point of the B-spline.
+    Point3D second;
+    uint32_t degree;
+    uint32_t pole_count;
+    uint32_t knot_count;
+    uint32_t reserved;
+    uint64_t side_offset;
+};
+
+static_assert(sizeof(SegmentFileHeader) == 112);
+static_assert(sizeof(SegmentRecord) == 80);
+
+// A segment file being assembled in memory, before it is written.
+struct SegmentFileContents
+{
+    std::vector<SegmentRecord> records;
+    std::vector<double> side;
+    std::array<uint64_t, 4> kind_counts {};
+    // Stay inverted while there are no segments.
+    Point3D bounds_min {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    Point3D bounds_max {std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+
+    void add_to_bounds(const Point3D& p);
+
+    void write(const std::string& filepath) const;
+};
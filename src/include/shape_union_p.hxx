@@ -0,0 +1,50 @@
+#pragma once
+
+// Standard library.
+#include <vector>
+#include <cstddef>
+#include <functional>
+
+// Third party.
+#include "TopoDS_Shape.hxx"
+
+class Instrumentation;
+struct BuildOptions;
+
+std::size_t count_faces(const TopoDS_Shape& s);
+
+TopoDS_Shape fuse_pair(const TopoDS_Shape& s1, 
+                       const TopoDS_Shape& s2,
+                       const char* const span_name,
+                       const char* const counter_name,
+                       Instrumentation* const instrumentation=nullptr);
+
+TopoDS_Shape fuse_sequential(const std::vector<TopoDS_Shape>& shapes,
+                             Instrumentation* const instrumentation=nullptr);
+
+std::vector<std::size_t> spatial_order(const std::vector<TopoDS_Shape>& shapes);
+
+TopoDS_Shape fuse_tree_reduction(const std::vector<TopoDS_Shape>& shapes,
+                                 const unsigned int threads,
+                                 Instrumentation* const instrumentation=nullptr);
+
+TopoDS_Shape fuse_general(const std::vector<TopoDS_Shape>& shapes,
+                          const double fuzzy_value,
+                          const bool use_obb,
+                          Instrumentation* const instrumentation=nullptr);
+
+TopoDS_Shape fuse_with_mode(const BuildOptions& options,
+                            const std::vector<TopoDS_Shape>& shapes,
+                            const unsigned int workers,
+                            Instrumentation* const instrumentation=nullptr);
+
+std::vector<std::vector<std::size_t>> overlapping_clusters(const std::vector<TopoDS_Shape>& shapes,
+                                                           const bool use_obb,
+                                                           const unsigned int threads);
+
+TopoDS_Shape fuse_clusters(const std::vector<TopoDS_Shape>& shapes,
+                           const bool use_obb,
+                           const unsigned int threads,
+                           const std::function<TopoDS_Shape(const std::vector<TopoDS_Shape>&,
+                                                             const unsigned int)>& fuse,
+                           Instrumentation* const instrumentation=nullptr);
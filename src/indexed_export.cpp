@@ -0,0 +1,265 @@
+// Standard library.
+#include <vector>
+#include <string>
+#include <cassert>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Third party.
+
+// OCCT.
+
+// Library public.
+#include "toolpath.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "mesh_export_p.hxx"
+#include "parallel_p.hxx"
+#include "instrumentation_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Vertices and faces of .ply files are encoded in chunks of this many.
+const std::size_t PLY_CHUNK_ITEMS {1 << 16};
+
+// Upper bound on the length of one formatted "v" or "f" line of a .obj file.
+const std::size_t OBJ_LINE_BYTES {80};
+
+static void append_index(std::string& out, const uint32_t value);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+static void append_index(std::string& out, const uint32_t value)
+{
+    char digits[16];
+    const std::to_chars_result res {std::to_chars(digits, digits + sizeof(digits), value)};
+    assert(res.ec == std::errc {});
+    out.append(digits, res.ptr);
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    Writes an indexed mesh to a binary little-endian .ply file. See
+        ToolPath::shape_to_ply().
+
+    Returns:
+        The number of bytes written to the file.
+*/
+std::size_t write_ply(const std::string& filepath,
+                      const IndexedMesh& mesh,
+                      const BuildOptions& options)
+{
+    const std::string header {"ply\n"
+                              "format binary_little_endian 1.0\n"
+                              "element vertex " + std::to_string(mesh.vertex_count()) + "\n"
+                              "property float x\n"
+                              "property float y\n"
+                              "property float z\n"
+                              "element face " + std::to_string(mesh.triangle_count()) + "\n"
+                              "property list uchar uint vertex_indices\n"
+                              "end_header\n"};
+
+    const std::size_t VERTEX_BYTES {3 * sizeof(float)};
+    const std::size_t FACE_BYTES {1 + VERTICES_PER_TRIANGLE * sizeof(uint32_t)};
+    const std::size_t vertices_start {header.size()};
+    const std::size_t faces_start {vertices_start + VERTEX_BYTES * mesh.vertex_count()};
+    const std::size_t size {faces_start + FACE_BYTES * mesh.triangle_count()};
+
+    // Vertices and faces are encoded concurrently in chunks.
+    const std::size_t vertex_chunks {(mesh.vertex_count() + PLY_CHUNK_ITEMS - 1) / PLY_CHUNK_ITEMS};
+    const std::size_t face_chunks {(mesh.triangle_count() + PLY_CHUNK_ITEMS - 1) / PLY_CHUNK_ITEMS};
+
+    const auto fill = [&](char* const file)
+    {
+        std::copy(header.begin(), header.end(), file);
+
+        parallel_for(vertex_chunks + face_chunks, options.threads,
+                     [&](const std::size_t chunk)
+                     {
+                         if (chunk < vertex_chunks)
+                         {
+                             const std::size_t first {chunk * PLY_CHUNK_ITEMS};
+                             const std::size_t last {std::min(first + PLY_CHUNK_ITEMS, mesh.vertex_count())};
+                             char* out {file + vertices_start + VERTEX_BYTES * first};
+                             for (std::size_t i {3 * first}; i < 3 * last; ++i)
+                                 out = put_float32(out, static_cast<float>(mesh.positions[i]));
+                         }
+                         else
+                         {
+                             const std::size_t first {(chunk - vertex_chunks) * PLY_CHUNK_ITEMS};
+                             const std::size_t last {std::min(first + PLY_CHUNK_ITEMS, mesh.triangle_count())};
+                             char* out {file + faces_start + FACE_BYTES * first};
+                             for (std::size_t i {first}; i < last; ++i)
+                             {
+                                 *out++ = static_cast<char>(VERTICES_PER_TRIANGLE);
+                                 for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+                                     out = put_uint32(out, mesh.indices[3 * i + k]);
+                             }
+                         }
+                     });
+    };
+    return write_output(filepath, size, options, fill);
+}
+
+/*
+    Writes the meshed toolpath to a binary little-endian .ply file. Even if the
+        file already exists, it is completely overwritten. Coincident vertices
+        of neighbouring faces are written once, and triangles refer to them by
+        index.
+    See http://paulbourke.net/dataformats/ply/ for the format.
+
+    Notes:
+        Coordinates are written as float32, like binary .stl files.
+        The file is encoded concurrently, either straight into a mapping of the
+            file or into a buffer written in a single call. See 
+            BuildOptions::mapped_output and BuildOptions::output_compression.
+
+    Assumes:
+        (1) The caller is OK with the file being overwritten if it already exists.
+        (2) The toolpath has already been meshed in a satisfactory way.
+
+    Arguments:
+        filepath:       Absolute path to the file to write to.
+        weld_tolerance: Vertices closer than this are merged. Must be positive.
+
+    Returns:
+        None.
+*/
+void ToolPath::shape_to_ply(const std::string filepath,
+                            const double weld_tolerance) const
+{
+    const ScopedSpan span {this->options.instrumentation, "write ply"};
+
+    const IndexedMesh mesh {weld_triangulations(collect_triangulations(this->toolpath_shape_union), weld_tolerance)};
+
+    const std::size_t bytes_written {write_ply(filepath, mesh, this->options)};
+
+    if (this->options.instrumentation)
+    {
+        this->options.instrumentation->add_to_counter("welded vertices", mesh.vertex_count());
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+    }
+}
+
+/*
+    Writes the meshed toolpath to a Wavefront .obj file. Even if the file
+        already exists, it is completely overwritten. Coincident vertices of
+        neighbouring faces are written once, and triangles refer to them by
+        index.
+
+    Notes:
+        Coordinates are written with the precision of text .stl files.
+        The whole file is assembled in memory and written in a single call, or
+            compressed if BuildOptions::output_compression asks for it.
+
+    Assumes:
+        (1) The caller is OK with the file being overwritten if it already exists.
+        (2) The toolpath has already been meshed in a satisfactory way.
+
+    Arguments:
+        filepath:       Absolute path to the file to write to.
+        weld_tolerance: Vertices closer than this are merged. Must be positive.
+
+    Returns:
+        None.
+*/
+void ToolPath::shape_to_obj(const std::string filepath,
+                            const double weld_tolerance) const
+{
+    const ScopedSpan span {this->options.instrumentation, "write obj"};
+
+    const IndexedMesh mesh {weld_triangulations(collect_triangulations(this->toolpath_shape_union), weld_tolerance)};
+
+    std::string out;
+    out.reserve(OBJ_LINE_BYTES * (mesh.vertex_count() + mesh.triangle_count()));
+
+    for (std::size_t v {0}; v < mesh.vertex_count(); ++v)
+    {
+        out += "v ";
+        append_number(out, mesh.positions[3 * v]);
+        out += ' ';
+        append_number(out, mesh.positions[3 * v + 1]);
+        out += ' ';
+        append_number(out, mesh.positions[3 * v + 2]);
+        out += '\n';
+    }
+
+    // Indices in .obj files start at one.
+    for (std::size_t i {0}; i < mesh.triangle_count(); ++i)
+    {
+        out += 'f';
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            out += ' ';
+            append_index(out, mesh.indices[3 * i + k] + 1);
+        }
+        out += '\n';
+    }
+
+    const std::size_t bytes_written {write_text(filepath, out, this->options)};
+
+    if (this->options.instrumentation)
+    {
+        this->options.instrumentation->add_to_counter("welded vertices", mesh.vertex_count());
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+    }
+}
+
+/*
+    Gives in-process consumers the meshed toolpath without writing a file. The
+        arrays are those that shape_to_glb() writes, in double precision and
+        with per-triangle face ids.
+
+    Notes:
+        The arrays are built on the first call after mesh_surface() and shared
+            by later calls, until mesh_surface() meshes the shape again. Views
+            obtained before then dangle afterwards.
+        Concurrent calls are safe. The first one builds the arrays and the
+            others wait for it.
+
+    Assumes:
+        (1) The toolpath has already been meshed in a satisfactory way.
+
+    Returns:
+        Views of the mesh arrays. They stay valid as long as the toolpath does
+            and isn't meshed again. Empty views if the toolpath was never
+            meshed.
+*/
+MeshView ToolPath::mesh_view() const
+{
+    if (!this->mesh_buffers)
+        return MeshView {};
+
+    MeshBuffers& buffers {*this->mesh_buffers};
+    std::call_once(buffers.built,
+                   [&]()
+                   {
+                       const ScopedSpan span {this->options.instrumentation, "mesh buffers"};
+
+                       buffers.mesh = weld_triangulations(collect_triangulations(this->toolpath_shape_union), DEFAULT_WELD_TOLERANCE);
+                       buffers.normals = vertex_normals(buffers.mesh);
+                   });
+
+    return {buffers.mesh.positions, buffers.normals, buffers.mesh.indices, buffers.mesh.face_ids};
+}
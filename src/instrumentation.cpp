@@ -0,0 +1,220 @@
+// Standard library.
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cassert>
+
+// Library public.
+#include "instrumentation.hxx"
+
+/* 
+   ****************************************************************************
+                           File Local Declarations 
+   ****************************************************************************
+*/ 
+
+static double microseconds(const Instrumentation::Clock::duration d);
+
+static std::string json_escape(const std::string& s);
+
+/* **************************************************************************** */
+
+
+/* 
+   ****************************************************************************
+                           File Local Definitions 
+   ****************************************************************************
+*/ 
+
+static double microseconds(const Instrumentation::Clock::duration d)
+{
+    return std::chrono::duration<double, std::micro>(d).count();
+}
+
+static std::string json_escape(const std::string& s)
+{
+    std::string escaped;
+    for (const char c : s)
+    {
+        if (c == '"' or c == '\\')
+            escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+/* **************************************************************************** */
+
+Instrumentation::Instrumentation()
+    : origin(Clock::now())
+{
+}
+
+/*
+    Small, stable numbers for the threads that record spans, in order of first
+        appearance. The calling thread must hold the mutex.
+*/
+int Instrumentation::thread_number()
+{
+    const auto [it, inserted] {this->thread_numbers.try_emplace(std::this_thread::get_id(), this->thread_numbers.size())};
+    return it->second;
+}
+
+/*
+    Records that the calling thread spent the time between start and end in a
+        named stage. Safe to call from several threads at once.
+
+    Arguments:
+        name:    Name of the stage.
+        start:   When the stage started.
+        end:     When the stage ended.
+        segment: Index of the segment that the stage worked on, or -1 when the
+                     stage isn't about a single segment.
+*/
+void Instrumentation::record_span(const std::string& name,
+                                  const Clock::time_point start,
+                                  const Clock::time_point end,
+                                  const int64_t segment)
+{
+    const std::lock_guard<std::mutex> lock {this->mutex};
+    this->spans.push_back(Span {name, start, end, thread_number(), segment});
+}
+
+/*
+    Adds to a running total, such as the number of Boolean operations.
+*/
+void Instrumentation::add_to_counter(const std::string& name, const int64_t amount)
+{
+    const std::lock_guard<std::mutex> lock {this->mutex};
+    this->counters[name] += amount;
+}
+
+/*
+    Records the value of a quantity that changes over time, such as the number
+        of faces of the union after each fuse.
+*/
+void Instrumentation::sample_counter(const std::string& name, const int64_t value)
+{
+    const std::lock_guard<std::mutex> lock {this->mutex};
+    this->samples.push_back(Sample {name, Clock::now(), value});
+}
+
+/*
+    Writes everything recorded so far in the Chrome trace event format. The file
+        can be loaded by chrome://tracing or https://ui.perfetto.dev. Spans
+        become complete ("X") events on the thread that recorded them, samples
+        become counter ("C") events, and totals are stored as metadata.
+
+    Arguments:
+        filepath: Path of the file to write. Overwritten if it exists.
+
+    Returns:
+        None.
+*/
+void Instrumentation::write_chrome_trace(const std::string& filepath) const
+{
+    const std::lock_guard<std::mutex> lock {this->mutex};
+
+    std::ofstream f {filepath};
+    assert(f.good());
+    f << std::fixed << std::setprecision(3);
+
+    f << "{\"traceEvents\":[";
+    bool first {true};
+    for (const Span& span : this->spans)
+    {
+        f << (first ? "\n" : ",\n");
+        first = false;
+        f << "{\"name\":\"" << json_escape(span.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << span.thread
+          << ",\"ts\":" << microseconds(span.start - this->origin)
+          << ",\"dur\":" << microseconds(span.end - span.start);
+        if (span.segment >= 0)
+            f << ",\"args\":{\"segment\":" << span.segment << "}";
+        f << "}";
+    }
+    for (const Sample& sample : this->samples)
+    {
+        f << (first ? "\n" : ",\n");
+        first = false;
+        f << "{\"name\":\"" << json_escape(sample.name) << "\",\"ph\":\"C\",\"pid\":1"
+          << ",\"ts\":" << microseconds(sample.time - this->origin)
+          << ",\"args\":{\"value\":" << sample.value << "}}";
+    }
+    f << "\n],\"otherData\":{";
+    first = true;
+    for (const auto& [name, total] : this->counters)
+    {
+        f << (first ? "" : ",") << "\"" << json_escape(name) << "\":" << total;
+        first = false;
+    }
+    f << "}}\n";
+}
+
+/*
+    Formats a table with one row per stage (how many times it ran, and its
+        total, mean and longest wall time) followed by the counters. For
+        sampled quantities, the last and the largest sample are shown.
+*/
+std::string Instrumentation::summary() const
+{
+    const std::lock_guard<std::mutex> lock {this->mutex};
+
+    struct StageTotals
+    {
+        int64_t count {0};
+        double total {0};
+        double longest {0};
+    };
+
+    // Keep stages in order of first appearance.
+    std::vector<std::string> stage_order;
+    std::map<std::string, StageTotals> stages;
+    for (const Span& span : this->spans)
+    {
+        if (stages.find(span.name) == stages.end())
+            stage_order.push_back(span.name);
+
+        StageTotals& totals {stages[span.name]};
+        const double ms {microseconds(span.end - span.start) / 1000};
+        totals.count += 1;
+        totals.total += ms;
+        totals.longest = std::max(totals.longest, ms);
+    }
+
+    std::ostringstream table;
+    table << std::fixed << std::setprecision(3);
+    table << std::left << std::setw(24) << "stage" << std::right 
+          << std::setw(10) << "count" << std::setw(14) << "total ms" 
+          << std::setw(14) << "mean ms" << std::setw(14) << "max ms" << "\n";
+    for (const std::string& name : stage_order)
+    {
+        const StageTotals& totals {stages.at(name)};
+        table << std::left << std::setw(24) << name << std::right 
+              << std::setw(10) << totals.count << std::setw(14) << totals.total 
+              << std::setw(14) << totals.total / totals.count << std::setw(14) << totals.longest << "\n";
+    }
+
+    table << "\n" << std::left << std::setw(24) << "counter" << std::right << std::setw(14) << "value" << "\n";
+    for (const auto& [name, total] : this->counters)
+        table << std::left << std::setw(24) << name << std::right << std::setw(14) << total << "\n";
+
+    std::map<std::string, std::pair<int64_t, int64_t>> last_and_largest;
+    for (const Sample& sample : this->samples)
+    {
+        const auto [it, inserted] {last_and_largest.try_emplace(sample.name, sample.value, sample.value)};
+        it->second.first = sample.value;
+        it->second.second = std::max(it->second.second, sample.value);
+    }
+    for (const auto& [name, values] : last_and_largest)
+    {
+        table << std::left << std::setw(24) << name + " (last)" << std::right << std::setw(14) << values.first << "\n";
+        table << std::left << std::setw(24) << name + " (max)" << std::right << std::setw(14) << values.second << "\n";
+    }
+
+    return table.str();
+}
@@ -0,0 +1,103 @@
+// Standard library.
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+// POSIX.
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Library private.
+#include "mapped_file_p.hxx"
+
+/*
+    Creates the file, or truncates it if it exists, sizes it and maps it.
+
+    Arguments:
+        filepath: Absolute path to the file.
+        length:   Exact size of the file in bytes.
+
+    Throws:
+        std::runtime_error if the file can't be created, sized or mapped.
+*/
+MappedFile::MappedFile(const std::string& filepath, const std::size_t length)
+    : length(length)
+{
+    this->descriptor = open(filepath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (this->descriptor < 0)
+        throw std::runtime_error("Failed to open " + filepath + ": " + std::strerror(errno));
+
+    if (ftruncate(this->descriptor, static_cast<off_t>(length)) != 0)
+    {
+        const std::string error {std::strerror(errno)};
+        close(this->descriptor);
+        throw std::runtime_error("Failed to size " + filepath + ": " + error);
+    }
+
+    // Empty mappings are not allowed. An empty file needs no writing anyway.
+    if (length == 0)
+        return;
+
+    void* const address {mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, this->descriptor, 0)};
+    if (address == MAP_FAILED)
+    {
+        const std::string error {std::strerror(errno)};
+        close(this->descriptor);
+        throw std::runtime_error("Failed to map " + filepath + ": " + error);
+    }
+    this->address = static_cast<char*>(address);
+}
+
+/*
+    Maps an existing file for reading. The kernel is told that the file will be
+        read from start to end, so it reads ahead aggressively.
+
+    Arguments:
+        filepath: Absolute path to the file.
+
+    Throws:
+        std::runtime_error if the file can't be opened, sized or mapped.
+*/
+MappedFile::MappedFile(const std::string& filepath)
+{
+    this->descriptor = open(filepath.c_str(), O_RDONLY);
+    if (this->descriptor < 0)
+        throw std::runtime_error("Failed to open " + filepath + ": " + std::strerror(errno));
+
+    struct stat status {};
+    if (fstat(this->descriptor, &status) != 0)
+    {
+        const std::string error {std::strerror(errno)};
+        close(this->descriptor);
+        throw std::runtime_error("Failed to size " + filepath + ": " + error);
+    }
+    this->length = static_cast<std::size_t>(status.st_size);
+
+    // Empty mappings are not allowed. There is nothing to read anyway.
+    if (this->length == 0)
+        return;
+
+    void* const address {mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, this->descriptor, 0)};
+    if (address == MAP_FAILED)
+    {
+        const std::string error {std::strerror(errno)};
+        close(this->descriptor);
+        throw std::runtime_error("Failed to map " + filepath + ": " + error);
+    }
+    madvise(address, this->length, MADV_SEQUENTIAL);
+    this->address = static_cast<char*>(address);
+}
+
+/*
+    Unmapping hands the written pages to the kernel, which writes them back to
+        the file in its own time. Read-only mappings are simply dropped.
+*/
+MappedFile::~MappedFile()
+{
+    if (this->address)
+        munmap(this->address, this->length);
+    close(this->descriptor);
+}
@@ -0,0 +1,583 @@
+// Standard library.
+#include <vector>
+#include <string>
+#include <array>
+#include <unordered_map>
+#include <cassert>
+#include <cmath>
+#include <bit>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <fstream>
+#include <functional>
+#include <algorithm>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "BRep_Tool.hxx"
+#include "TopoDS.hxx"
+#include "TopoDS_Face.hxx"
+#include "TopExp_Explorer.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "mesh_export_p.hxx"
+#include "mapped_file_p.hxx"
+#include "compression_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Marks the end of the list of vertices in a cell of the welding grid.
+const uint32_t NO_VERTEX {std::numeric_limits<uint32_t>::max()};
+
+// A cell of the welding grid, i.e. a coordinate divided by the tolerance and
+//     rounded down.
+typedef std::array<int64_t, 3> GridCell;
+
+struct GridCellHash
+{
+    std::size_t operator()(const GridCell& cell) const;
+};
+
+// Finds the vertex that a point welds to, adding one if there is none.
+class VertexWelder
+{
+    const double tolerance;
+    IndexedMesh& mesh;
+    // The first vertex of each occupied cell. The other vertices of the cell
+    //     follow through next_in_cell.
+    std::unordered_map<GridCell, uint32_t, GridCellHash> cell_heads;
+    std::vector<uint32_t> next_in_cell;
+
+    GridCell cell_of(const gp_Pnt& p) const;
+
+public:
+    VertexWelder(const double tolerance, IndexedMesh& mesh);
+
+    uint32_t weld(const gp_Pnt& p);
+};
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+std::size_t GridCellHash::operator()(const GridCell& cell) const
+{
+    std::size_t h {0};
+    for (const int64_t c : cell)
+        h ^= std::hash<int64_t> {}(c) + 0x9e3779b97f4a7c15 + (h << 6) + (h >> 2);
+    return h;
+}
+
+VertexWelder::VertexWelder(const double tolerance, IndexedMesh& mesh)
+    : tolerance(tolerance), mesh(mesh)
+{
+    assert(tolerance > 0);
+}
+
+GridCell VertexWelder::cell_of(const gp_Pnt& p) const
+{
+    return {static_cast<int64_t>(std::floor(p.X() / this->tolerance)),
+            static_cast<int64_t>(std::floor(p.Y() / this->tolerance)),
+            static_cast<int64_t>(std::floor(p.Z() / this->tolerance))};
+}
+
+/*
+    Returns the index of the first vertex within the tolerance of a point. If
+        there is none, the point becomes a new vertex.
+
+    Notes:
+        Cells are as wide as the tolerance, so any vertex within the tolerance
+            lies in the cell of the point or in one of its 26 neighbours.
+*/
+uint32_t VertexWelder::weld(const gp_Pnt& p)
+{
+    const GridCell cell {cell_of(p)};
+    const double squared_tolerance {this->tolerance * this->tolerance};
+
+    for (int64_t dx {-1}; dx <= 1; ++dx)
+        for (int64_t dy {-1}; dy <= 1; ++dy)
+            for (int64_t dz {-1}; dz <= 1; ++dz)
+            {
+                const auto head {this->cell_heads.find({cell[0] + dx, cell[1] + dy, cell[2] + dz})};
+                if (head == this->cell_heads.end())
+                    continue;
+
+                for (uint32_t v {head->second}; v != NO_VERTEX; v = this->next_in_cell[v])
+                {
+                    const double* q {&this->mesh.positions[3 * static_cast<std::size_t>(v)]};
+                    const double ex {q[0] - p.X()};
+                    const double ey {q[1] - p.Y()};
+                    const double ez {q[2] - p.Z()};
+                    if (ex * ex + ey * ey + ez * ez <= squared_tolerance)
+                        return v;
+                }
+            }
+
+    const std::size_t index {this->mesh.vertex_count()};
+    assert(index < NO_VERTEX);
+    this->mesh.positions.push_back(p.X());
+    this->mesh.positions.push_back(p.Y());
+    this->mesh.positions.push_back(p.Z());
+
+    const auto [head, inserted] = this->cell_heads.try_emplace(cell, static_cast<uint32_t>(index));
+    this->next_in_cell.push_back(inserted ? NO_VERTEX : head->second);
+    head->second = static_cast<uint32_t>(index);
+
+    return static_cast<uint32_t>(index);
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    Gathers the triangulations of the faces of a shape, in the order in which
+        the faces are explored. Faces that are not triangulated are skipped;
+        it's not the exporters' responsibility to deal with them.
+*/
+std::vector<FaceTriangulation> collect_triangulations(const TopoDS_Shape& shape)
+{
+    std::vector<FaceTriangulation> triangulations;
+    uint32_t face_id {0};
+    for (TopExp_Explorer face_it {shape, TopAbs_FACE}; face_it.More(); face_it.Next(), ++face_id)
+    {
+        const TopoDS_Face face {TopoDS::Face(face_it.Current())};
+        TopLoc_Location loc;
+        const Handle(Poly_Triangulation) poly_tri {BRep_Tool::Triangulation(face, loc)};
+        if (!poly_tri.IsNull())
+            triangulations.push_back({poly_tri, face.Orientation() == TopAbs_REVERSED, face_id});
+    }
+    return triangulations;
+}
+
+/*
+    Merges the triangulations of many faces into one indexed mesh. The faces
+        are triangulated independently, so every vertex on an edge between two
+        faces appears once per face; such copies become one vertex.
+
+    Notes:
+        Triangles of reversed faces are flipped, so that every triangle is
+            wound the same way relative to the solid.
+        Triangles that lose an edge to welding are dropped.
+        Vertices are numbered in the order in which they are first met, so the
+            mesh is the same from run to run.
+
+    Arguments:
+        triangulations: The faces to merge.
+        tolerance:      Vertices closer than this are welded. Must be positive.
+
+    Returns:
+        The welded mesh.
+*/
+IndexedMesh weld_triangulations(const std::vector<FaceTriangulation>& triangulations,
+                                const double tolerance)
+{
+    IndexedMesh mesh;
+
+    std::size_t nodes {0};
+    std::size_t triangles {0};
+    for (const FaceTriangulation& face : triangulations)
+    {
+        nodes += face.poly_tri->NbNodes();
+        triangles += face.poly_tri->NbTriangles();
+    }
+    mesh.positions.reserve(3 * nodes);
+    mesh.indices.reserve(3 * triangles);
+    mesh.face_ids.reserve(triangles);
+
+    VertexWelder welder {tolerance, mesh};
+
+    // Maps the nodes of the current face to welded vertices. Reused by every
+    //     face.
+    std::vector<uint32_t> node_vertices;
+    for (const FaceTriangulation& face : triangulations)
+    {
+        const Handle(Poly_Triangulation)& poly_tri {face.poly_tri};
+
+        node_vertices.resize(poly_tri->NbNodes());
+        for (int n {1}; n <= poly_tri->NbNodes(); ++n)
+            node_vertices[n - 1] = welder.weld(poly_tri->Node(n));
+
+        for (int tri_it {1}; tri_it <= poly_tri->NbTriangles(); ++tri_it)
+        {
+            int v1_idx, v2_idx, v3_idx;
+            poly_tri->Triangle(tri_it).Get(v1_idx, v2_idx, v3_idx);
+            if (face.reversed)
+                std::swap(v2_idx, v3_idx);
+
+            const uint32_t a {node_vertices[v1_idx - 1]};
+            const uint32_t b {node_vertices[v2_idx - 1]};
+            const uint32_t c {node_vertices[v3_idx - 1]};
+            if (a == b or b == c or c == a)
+                continue;
+
+            mesh.indices.push_back(a);
+            mesh.indices.push_back(b);
+            mesh.indices.push_back(c);
+            mesh.face_ids.push_back(face.face_id);
+        }
+    }
+
+    return mesh;
+}
+
+/*
+    Closes the cracks left where meshes that were triangulated apart meet, such
+        as the tiles of a TiledToolPath. Welding joins the two sides of such a
+        seam only where both sides have a vertex. Wherever a vertex of one side
+        lies on an edge of the other (a T-junction), the triangle of the edge
+        is split at the vertex, so that both sides end up with the same
+        vertices along the seam.
+
+    Notes:
+        Only open edges, used by a single triangle, are looked at. Edges inside
+            a closed surface are left alone.
+        A triangle is split into a fan around the vertex opposite the edge.
+            The pieces keep the face id and the winding of the triangle.
+        Open edges are found in triangle order, so the result is the same from
+            run to run.
+
+    Arguments:
+        mesh:      A welded mesh. See weld_triangulations().
+        tolerance: Largest distance from an edge at which a vertex is inserted
+                       into it. Must be positive.
+
+    Returns:
+        The number of vertices inserted into edges.
+*/
+std::size_t close_t_junctions(IndexedMesh& mesh, const double tolerance)
+{
+    assert(tolerance > 0);
+
+    const auto edge_key = [](const uint32_t a, const uint32_t b)
+    {
+        return (static_cast<uint64_t>(a) << 32) | b;
+    };
+    const auto position = [&mesh](const uint32_t v)
+    {
+        return &mesh.positions[3 * static_cast<std::size_t>(v)];
+    };
+
+    // The triangle that holds each directed edge.
+    std::unordered_map<uint64_t, std::size_t> edge_triangles;
+    edge_triangles.reserve(3 * mesh.triangle_count());
+    for (std::size_t t {0}; t < mesh.triangle_count(); ++t)
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+            edge_triangles[edge_key(mesh.indices[3 * t + k], mesh.indices[3 * t + (k + 1) % 3])] = t;
+
+    std::vector<std::pair<uint32_t, uint32_t>> open_edges;
+    double open_length {0};
+    for (std::size_t t {0}; t < mesh.triangle_count(); ++t)
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            const uint32_t a {mesh.indices[3 * t + k]};
+            const uint32_t b {mesh.indices[3 * t + (k + 1) % 3]};
+            if (edge_triangles.contains(edge_key(b, a)))
+                continue;
+            open_edges.emplace_back(a, b);
+            const double* pa {position(a)};
+            const double* pb {position(b)};
+            open_length += std::hypot(pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]);
+        }
+    if (open_edges.empty())
+        return 0;
+
+    // The vertices of open edges, in cells about as wide as an open edge is
+    //     long, so that each edge only looks at a few cells.
+    const double cell_size {std::max(tolerance, open_length / open_edges.size())};
+    const auto cell_of = [cell_size](const double x, const double y, const double z)
+    {
+        return GridCell {static_cast<int64_t>(std::floor(x / cell_size)),
+                         static_cast<int64_t>(std::floor(y / cell_size)),
+                         static_cast<int64_t>(std::floor(z / cell_size))};
+    };
+    std::unordered_map<GridCell, std::vector<uint32_t>, GridCellHash> cells;
+    std::vector<bool> listed(mesh.vertex_count(), false);
+    for (const auto& [a, b] : open_edges)
+        for (const uint32_t v : {a, b})
+        {
+            if (listed[v])
+                continue;
+            listed[v] = true;
+            const double* p {position(v)};
+            cells[cell_of(p[0], p[1], p[2])].push_back(v);
+        }
+
+    std::size_t inserted {0};
+    // The vertices found on an edge, by their parameter along the edge.
+    std::vector<std::pair<double, uint32_t>> on_edge;
+    for (const auto& [a, b] : open_edges)
+    {
+        // Earlier splits may have moved the edge to another triangle.
+        const std::size_t t {edge_triangles.at(edge_key(a, b))};
+        int k {0};
+        while (mesh.indices[3 * t + k] != a)
+            ++k;
+        const uint32_t c {mesh.indices[3 * t + (k + 2) % 3]};
+
+        const double* pa {position(a)};
+        const double* pb {position(b)};
+        const double d[3] {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+        const double squared_length {d[0] * d[0] + d[1] * d[1] + d[2] * d[2]};
+        if (squared_length == 0)
+            continue;
+
+        on_edge.clear();
+        const GridCell low {cell_of(std::min(pa[0], pb[0]) - tolerance,
+                                    std::min(pa[1], pb[1]) - tolerance,
+                                    std::min(pa[2], pb[2]) - tolerance)};
+        const GridCell high {cell_of(std::max(pa[0], pb[0]) + tolerance,
+                                     std::max(pa[1], pb[1]) + tolerance,
+                                     std::max(pa[2], pb[2]) + tolerance)};
+        for (int64_t x {low[0]}; x <= high[0]; ++x)
+            for (int64_t y {low[1]}; y <= high[1]; ++y)
+                for (int64_t z {low[2]}; z <= high[2]; ++z)
+                {
+                    const auto cell {cells.find({x, y, z})};
+                    if (cell == cells.end())
+                        continue;
+
+                    for (const uint32_t v : cell->second)
+                    {
+                        if (v == a or v == b or v == c)
+                            continue;
+                        const double* p {position(v)};
+                        const double e[3] {p[0] - pa[0], p[1] - pa[1], p[2] - pa[2]};
+                        const double along {(e[0] * d[0] + e[1] * d[1] + e[2] * d[2]) / squared_length};
+                        if (along <= 0 or along >= 1)
+                            continue;
+                        const double ex {e[0] - along * d[0]};
+                        const double ey {e[1] - along * d[1]};
+                        const double ez {e[2] - along * d[2]};
+                        if (ex * ex + ey * ey + ez * ez <= tolerance * tolerance)
+                            on_edge.emplace_back(along, v);
+                    }
+                }
+        if (on_edge.empty())
+            continue;
+        std::sort(on_edge.begin(), on_edge.end());
+
+        // The triangle becomes (a, v1, c), followed by (v1, v2, c) and so on
+        //     up to (vn, b, c).
+        const uint32_t face_id {mesh.face_ids[t]};
+        edge_triangles.erase(edge_key(a, b));
+        mesh.indices[3 * t + (k + 1) % 3] = on_edge.front().second;
+        edge_triangles[edge_key(a, on_edge.front().second)] = t;
+        edge_triangles[edge_key(on_edge.front().second, c)] = t;
+
+        uint32_t previous {on_edge.front().second};
+        for (std::size_t i {1}; i <= on_edge.size(); ++i)
+        {
+            const uint32_t next {i < on_edge.size() ? on_edge[i].second : b};
+            const std::size_t piece {mesh.triangle_count()};
+            mesh.indices.insert(mesh.indices.end(), {previous, next, c});
+            mesh.face_ids.push_back(face_id);
+            edge_triangles[edge_key(previous, next)] = piece;
+            edge_triangles[edge_key(next, c)] = piece;
+            edge_triangles[edge_key(c, previous)] = piece;
+            previous = next;
+        }
+        inserted += on_edge.size();
+    }
+
+    return inserted;
+}
+
+/*
+    Computes a unit normal at every vertex of a welded mesh by summing the
+        normals of the triangles around it, weighted by their areas.
+
+    Notes:
+        Vertices on sharp edges are shared by faces that point different ways,
+            so their normals are a compromise between the faces.
+        A vertex whose triangles cancel out gets +Z, so that every normal has
+            unit length.
+
+    Arguments:
+        mesh: The mesh.
+
+    Returns:
+        The normal of vertex i is (normals[3 * i], normals[3 * i + 1],
+            normals[3 * i + 2]).
+*/
+std::vector<double> vertex_normals(const IndexedMesh& mesh)
+{
+    std::vector<double> normals(mesh.positions.size(), 0);
+
+    for (std::size_t i {0}; i < mesh.triangle_count(); ++i)
+    {
+        const uint32_t* corners {&mesh.indices[3 * i]};
+        const double* p0 {&mesh.positions[3 * static_cast<std::size_t>(corners[0])]};
+        const double* p1 {&mesh.positions[3 * static_cast<std::size_t>(corners[1])]};
+        const double* p2 {&mesh.positions[3 * static_cast<std::size_t>(corners[2])]};
+
+        const double ux {p1[0] - p0[0]};
+        const double uy {p1[1] - p0[1]};
+        const double uz {p1[2] - p0[2]};
+        const double vx {p2[0] - p0[0]};
+        const double vy {p2[1] - p0[1]};
+        const double vz {p2[2] - p0[2]};
+
+        // The length of the cross product is twice the area of the triangle.
+        const double cx {uy * vz - uz * vy};
+        const double cy {uz * vx - ux * vz};
+        const double cz {ux * vy - uy * vx};
+
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            double* n {&normals[3 * static_cast<std::size_t>(corners[k])]};
+            n[0] += cx;
+            n[1] += cy;
+            n[2] += cz;
+        }
+    }
+
+    for (std::size_t v {0}; v < mesh.vertex_count(); ++v)
+    {
+        double* n {&normals[3 * v]};
+        const double length {std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2])};
+        if (length > 0)
+        {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+        else
+        {
+            n[0] = 0;
+            n[1] = 0;
+            n[2] = 1;
+        }
+    }
+
+    return normals;
+}
+
+/*
+    Writes a file whose exact size is known in advance. The caller fills the
+        bytes in place, possibly from many threads, and they reach the file
+        without any further copy.
+
+    Notes:
+        With BuildOptions::mapped_output, the file is mapped into memory and
+            filled in place. Otherwise the bytes are filled into a buffer that
+            is written with a single call.
+        With BuildOptions::output_compression, the bytes are filled into a
+            buffer and compressed in parallel blocks. Mapping is pointless
+            then, since the compressed size isn't known in advance.
+
+    Arguments:
+        filepath: Absolute path to the file to write to. Overwritten if it
+                      exists.
+        size:     Exact size of the uncompressed data in bytes.
+        options:  Selects the way of writing, and the number of workers.
+        fill:     Called once with the start of the size bytes to fill in.
+
+    Returns:
+        The number of bytes written to the file.
+*/
+std::size_t write_output(const std::string& filepath,
+                         const std::size_t size,
+                         const BuildOptions& options,
+                         const std::function<void(char*)>& fill)
+{
+    if (options.mapped_output and options.output_compression == Compression::none)
+    {
+        const MappedFile file {filepath, size};
+        fill(file.data());
+        return size;
+    }
+
+    std::vector<char> buffer(size);
+    fill(buffer.data());
+
+    std::ofstream f {filepath, std::ios::binary};
+    assert(f.good());
+    std::size_t bytes_written {size};
+    if (options.output_compression == Compression::gzip)
+        bytes_written = write_gzip(f, buffer.data(), buffer.size(), options.threads);
+    else
+        f.write(buffer.data(), buffer.size());
+    assert(f.good());
+
+    return bytes_written;
+}
+
+/*
+    Writes text that has already been formatted, compressing it if
+        BuildOptions::output_compression asks for it.
+
+    Returns:
+        The number of bytes written to the file.
+*/
+std::size_t write_text(const std::string& filepath,
+                       const std::string& text,
+                       const BuildOptions& options)
+{
+    std::ofstream f {filepath, std::ios::binary};
+    assert(f.good());
+    std::size_t bytes_written {text.size()};
+    if (options.output_compression == Compression::gzip)
+        bytes_written = write_gzip(f, text.data(), text.size(), options.threads);
+    else
+        f.write(text.data(), text.size());
+    assert(f.good());
+
+    return bytes_written;
+}
+
+/*
+    Appends a number formatted like an iostream with a precision of
+        FP_WRITE_PRECISION would format it, i.e. like printf's "%.15g".
+*/
+void append_number(std::string& out, const double value)
+{
+    char digits[32];
+    const std::to_chars_result res {std::to_chars(digits, digits + sizeof(digits), value,
+                                                  std::chars_format::general, FP_WRITE_PRECISION)};
+    assert(res.ec == std::errc {});
+    out.append(digits, res.ptr);
+}
+
+/*
+    Writes a value in little-endian byte order, whatever the byte order of the
+        host.
+
+    Returns:
+        The position just past the written bytes.
+*/
+char* put_uint16(char* out, const uint16_t value)
+{
+    out[0] = static_cast<char>(value & 0xFF);
+    out[1] = static_cast<char>((value >> 8) & 0xFF);
+    return out + sizeof(uint16_t);
+}
+
+char* put_uint32(char* out, const uint32_t value)
+{
+    for (std::size_t i {0}; i < sizeof(uint32_t); ++i)
+        out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+    return out + sizeof(uint32_t);
+}
+
+char* put_float32(char* out, const float value)
+{
+    static_assert(sizeof(float) == sizeof(uint32_t));
+    return put_uint32(out, std::bit_cast<uint32_t>(value));
+}
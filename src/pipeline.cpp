@@ -0,0 +1,530 @@
+// Standard library.
+#include <string>
+#include <vector>
+#include <map>
+#include <optional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <fstream>
+#include <exception>
+#include <utility>
+#include <variant>
+#include <cstdint>
+#include <limits>
+#include <algorithm>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "TopoDS.hxx"
+#include "TopoDS_Face.hxx"
+#include "TopoDS_Shape.hxx"
+#include "TopExp_Explorer.hxx"
+#include "BRep_Tool.hxx"
+#include "BRepLib_ToolTriangulatedShape.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+#include "gcode.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "bounded_queue_p.hxx"
+#include "shape_union_p.hxx"
+#include "mesh_export_p.hxx"
+#include "compression_p.hxx"
+#include "parallel_p.hxx"
+#include "instrumentation_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Faces are encoded in blocks of roughly this many triangles.
+const std::size_t PIPELINE_BLOCK_TRIANGLES {1 << 15};
+
+// Consecutive segments on their way from the parse stage to the sweep stage.
+struct SweepBatch
+{
+    // Position of the batch in the program, counting from zero.
+    std::size_t sequence;
+    SegmentList segments;
+    // Whether each segment needs a start cap. See BuildOptions::shared_caps.
+    std::vector<bool> start_caps;
+};
+
+// The solids of a SweepBatch on their way to the union stage.
+struct SolidBatch
+{
+    std::size_t sequence;
+    std::vector<TopoDS_Shape> solids;
+};
+
+// Encoded faces on their way from the encoding stage to the writer.
+struct EncodedBlock
+{
+    std::size_t sequence;
+    std::string bytes;
+};
+
+// Thrown from the parser callback to stop parsing once a later stage failed.
+struct ParseAbandoned {};
+
+/* **************************************************************************** */
+
+
+
+/*
+    Builds the toolpath of a G-code program, meshes it and writes it to an .stl
+        file, with the stages running concurrently rather than one after the
+        other:
+
+            parse -> sweep -> union -> mesh -> encode -> write
+
+        The parser hands batches of segments to the sweep workers while it is
+        still reading, and the union stage fuses the solids of each batch while
+        later batches are being swept. Once the union is complete, the shape is
+        meshed, and blocks of faces are encoded while earlier blocks are
+        written.
+
+    Notes:
+        Stages are connected by BoundedQueue. A stage that runs ahead of the
+            next one waits, so no more than PipelineOptions::queue_capacity
+            batches of segments, batches of solids or encoded blocks are held
+            between two stages, whatever the size of the program.
+        The sweep workers only start on a batch once the union stage is
+            within PipelineOptions::queue_capacity batches of it, so a slow
+            batch holds back the batches after it instead of letting their
+            solids pile up while the union stage waits for it.
+        The union and the mesh need every solid, so they can't overlap the
+            stages after them. The shape is meshed in one pass rather than
+            face by face, so that neighboring faces agree on the points of
+            their common edges. The vertex normals, the encoding and the
+            compression are done face by face. The vertex normals are computed
+            whatever the facet normals of the file, so that the returned
+            toolpath can be exported again like one meshed by mesh_surface().
+        Solids are fused in program order, whatever order the sweep workers
+            finish in, and blocks are written in face order, so the file is
+            the same from run to run. When the whole program fits in one
+            batch and BuildOptions::cluster_disjoint is off, the solids are
+            fused as the constructor fuses them, and the file is the one
+            shape_to_stl() writes, except for where gzip members start.
+        Arc fitting and coalescing are done by the parser, on each batch of
+            segments. See PipelineOptions::batch_segments.
+
+    Arguments:
+        gcode_filepath:   Absolute path to the program. See parse_gcode().
+        profile:          The cross section of the tool.
+        angle:            See mesh_surface().
+        deflection:       See mesh_surface().
+        solid_name:       See shape_to_stl().
+        stl_filepath:     Absolute path to the .stl file to write to.
+        format:           See shape_to_stl().
+        normals:          See shape_to_stl().
+        options:          As for ToolPath::ToolPath(). BuildOptions::threads is
+                              superseded by the workers of each stage.
+        pipeline_options: The workers of each stage and the capacity of the
+                              queues between them.
+
+    Throws:
+        The first exception thrown by any stage, once every stage has stopped.
+
+    Returns:
+        The meshed toolpath, which can be exported again in other formats.
+*/
+ToolPath ToolPath::pipeline(const std::string& gcode_filepath,
+                            const CylindricalTool& profile,
+                            const double angle,
+                            const double deflection,
+                            const std::string& solid_name,
+                            const std::string& stl_filepath,
+                            const StlFormat format,
+                            const FacetNormals normals,
+                            const BuildOptions& options,
+                            const PipelineOptions& pipeline_options)
+{
+    assert(pipeline_options.batch_segments > 0);
+    assert(pipeline_options.queue_capacity > 0);
+
+    Instrumentation* const instrumentation {options.instrumentation};
+    const ScopedSpan pipeline_span {instrumentation, "pipeline"};
+
+    ToolPath result {options};
+
+    BoundedQueue<SweepBatch> sweep_queue {pipeline_options.queue_capacity};
+    BoundedQueue<SolidBatch> solid_queue {pipeline_options.queue_capacity};
+
+    // How many batches the union stage has fused. Sweep workers wait on it.
+    std::size_t batches_united {0};
+    bool union_aborted {false};
+    std::mutex union_mutex;
+    std::condition_variable union_moved;
+
+    // The first failure of any stage. The queues are aborted so that the other
+    //     stages stop rather than wait forever.
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    const auto fail = [&]()
+    {
+        {
+            const std::lock_guard<std::mutex> lock {error_mutex};
+            if (!error)
+                error = std::current_exception();
+        }
+        sweep_queue.abort();
+        solid_queue.abort();
+        {
+            const std::lock_guard<std::mutex> lock {union_mutex};
+            union_aborted = true;
+        }
+        union_moved.notify_all();
+    };
+
+    // Parse. Segments are batched, simplified and given their start caps.
+    std::thread parser {[&]()
+    {
+        try
+        {
+            const ScopedSpan span {instrumentation, "parse"};
+
+            SegmentList pending;
+            pending.reserve(pipeline_options.batch_segments);
+            std::size_t sequence {0};
+            // The last segment of the previous batch, whose end cap may cover
+            //     the start of the next batch.
+            std::optional<Segment> previous;
+
+            const auto flush = [&]()
+            {
+                SegmentList segments {std::move(pending)};
+                pending = SegmentList {};
+                pending.reserve(pipeline_options.batch_segments);
+
+                if (options.arc_fitting_tolerance > 0)
+                    segments = fit_arcs(segments, options.arc_fitting_tolerance, result.arc_fitting_error);
+                if (options.coalesce_segments)
+                    segments = coalesce(segments, options.coalesce_tolerance);
+
+                std::vector<const Path*> paths;
+                paths.reserve(segments.size() + 1);
+                if (previous)
+                    paths.push_back(&segment_path(*previous));
+                for (const Segment& segment : segments)
+                    paths.push_back(&segment_path(segment));
+                std::vector<bool> start_caps {result.segment_start_caps(paths)};
+                if (previous)
+                    start_caps.erase(start_caps.begin());
+
+                previous = segments[segments.size() - 1];
+                if (instrumentation)
+                    instrumentation->add_to_counter("segments", segments.size());
+
+                if (!sweep_queue.push(SweepBatch {sequence++, std::move(segments), std::move(start_caps)}))
+                    throw ParseAbandoned {};
+            };
+
+            parse_gcode_file(gcode_filepath,
+                             [&](const GcodeMove& move)
+                             {
+                                 if (move.motion == GcodeMotion::rapid and !pipeline_options.include_rapids)
+                                     return;
+
+                                 append_gcode_move(move, pending);
+                                 if (pending.size() >= pipeline_options.batch_segments)
+                                     flush();
+                             });
+            if (!pending.empty())
+                flush();
+            sweep_queue.close();
+        }
+        catch (const ParseAbandoned&)
+        {
+        }
+        catch (...)
+        {
+            fail();
+        }
+    }};
+
+    // Sweep. Batches are taken in order, but only so far ahead of the union
+    //     stage. The last worker to finish tells the union stage that no more
+    //     solids are coming.
+    const unsigned int sweep_workers {resolve_thread_count(pipeline_options.sweep_threads)};
+    std::atomic<unsigned int> sweeping {sweep_workers};
+    std::vector<std::thread> sweepers;
+    sweepers.reserve(sweep_workers);
+    for (unsigned int w {0}; w < sweep_workers; ++w)
+    {
+        sweepers.emplace_back([&]()
+        {
+            try
+            {
+                while (std::optional<SweepBatch> batch {sweep_queue.pop()})
+                {
+                    {
+                        std::unique_lock<std::mutex> lock {union_mutex};
+                        union_moved.wait(lock, [&]() { return union_aborted or batch->sequence < batches_united + pipeline_options.queue_capacity; });
+                        if (union_aborted)
+                            break;
+                    }
+
+                    SolidBatch solids {batch->sequence, {}};
+                    solids.solids.reserve(batch->segments.size());
+                    for (std::size_t i {0}; i < batch->segments.size(); ++i)
+                    {
+                        const ScopedSpan span {instrumentation, "segment"};
+                        const Path& segment {segment_path(batch->segments[i])};
+                        if (options.union_mode == UnionMode::general_fuse)
+                        {
+                            const std::vector<TopoDS_Shape> parts {result.segment_parts(segment, profile, false, batch->start_caps[i])};
+                            solids.solids.insert(solids.solids.end(), parts.begin(), parts.end());
+                        }
+                        else
+                            solids.solids.push_back(result.segment_toolpath(segment, profile, false, batch->start_caps[i]));
+                    }
+
+                    if (instrumentation)
+                        instrumentation->add_to_counter("operands", solids.solids.size());
+                    if (!solid_queue.push(std::move(solids)))
+                        break;
+                }
+            }
+            catch (...)
+            {
+                fail();
+            }
+
+            if (sweeping.fetch_sub(1) == 1)
+                solid_queue.close();
+        });
+    }
+
+    // Union, on this thread. Batches are fused in program order as soon as
+    //     every batch before them has been fused.
+    const auto unite = [&options, instrumentation](const std::vector<TopoDS_Shape>& shapes,
+                                                   const unsigned int workers)
+    {
+        return fuse_with_mode(options, shapes, workers, instrumentation);
+    };
+
+    std::vector<TopoDS_Shape> batch_unions;
+    try
+    {
+        const ScopedSpan span {instrumentation, "union"};
+        std::map<std::size_t, std::vector<TopoDS_Shape>> waiting;
+        std::size_t next {0};
+        while (std::optional<SolidBatch> batch {solid_queue.pop()})
+        {
+            waiting.emplace(batch->sequence, std::move(batch->solids));
+            for (auto it {waiting.find(next)}; it != waiting.end(); it = waiting.find(next))
+            {
+                const TopoDS_Shape united {unite(it->second, pipeline_options.union_threads)};
+                waiting.erase(it);
+                ++next;
+                {
+                    const std::lock_guard<std::mutex> lock {union_mutex};
+                    batches_united = next;
+                }
+                union_moved.notify_all();
+
+                // Disjoint groups are only known once every batch is in.
+                if (options.cluster_disjoint)
+                    batch_unions.push_back(united);
+                else
+                    result.add_shape(united);
+            }
+        }
+    }
+    catch (...)
+    {
+        fail();
+    }
+
+    parser.join();
+    for (std::thread& t : sweepers)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    if (options.cluster_disjoint)
+    {
+        const ScopedSpan span {instrumentation, "union"};
+        result.toolpath_shape_union = fuse_clusters(batch_unions, options.use_obb, pipeline_options.union_threads,
+                                                    unite, instrumentation);
+    }
+
+    // Mesh. Normals are left to the encoding stage.
+    result.mesh_surface(angle, deflection, false);
+
+    std::vector<TopoDS_Face> faces;
+    std::vector<FaceTriangulation> triangulations;
+    uint32_t face_id {0};
+    for (TopExp_Explorer face_it {result.toolpath_shape_union, TopAbs_FACE}; face_it.More(); face_it.Next(), ++face_id)
+    {
+        const TopoDS_Face face {TopoDS::Face(face_it.Current())};
+        TopLoc_Location loc;
+        const Handle(Poly_Triangulation) poly_tri {BRep_Tool::Triangulation(face, loc)};
+        if (poly_tri.IsNull())
+            continue;
+        faces.push_back(face);
+        triangulations.push_back({poly_tri, face.Orientation() == TopAbs_REVERSED, face_id});
+    }
+
+    // Split the faces into blocks of consecutive faces.
+    std::vector<std::pair<std::size_t, std::size_t>> blocks;
+    std::size_t block_triangles {0};
+    std::size_t triangles {0};
+    for (std::size_t i {0}; i < triangulations.size(); ++i)
+    {
+        if (blocks.empty() or block_triangles >= PIPELINE_BLOCK_TRIANGLES)
+        {
+            blocks.emplace_back(i, i);
+            block_triangles = 0;
+        }
+        blocks.back().second = i + 1;
+        block_triangles += triangulations[i].poly_tri->NbTriangles();
+        triangles += triangulations[i].poly_tri->NbTriangles();
+    }
+    assert(format == StlFormat::ascii or triangles <= std::numeric_limits<uint32_t>::max());
+
+    // Encode. Workers take blocks in order, but only so far ahead of the
+    //     writer, so that the blocks waiting to be written stay bounded even
+    //     when one block takes much longer than the others.
+    const bool gzip {options.output_compression == Compression::gzip};
+    BoundedQueue<EncodedBlock> block_queue {pipeline_options.queue_capacity};
+    std::atomic<std::size_t> next_block {0};
+    std::size_t written {0};
+    bool aborted {false};
+    std::mutex window_mutex;
+    std::condition_variable window_moved;
+    const auto fail_encoding = [&]()
+    {
+        {
+            const std::lock_guard<std::mutex> lock {error_mutex};
+            if (!error)
+                error = std::current_exception();
+        }
+        block_queue.abort();
+        {
+            const std::lock_guard<std::mutex> lock {window_mutex};
+            aborted = true;
+        }
+        window_moved.notify_all();
+    };
+
+    const unsigned int encode_workers {static_cast<unsigned int>(
+        std::min<std::size_t>(resolve_thread_count(pipeline_options.encode_threads), std::max<std::size_t>(blocks.size(), 1)))};
+    std::atomic<unsigned int> encoding {encode_workers};
+    std::vector<std::thread> encoders;
+    encoders.reserve(encode_workers);
+    for (unsigned int w {0}; w < encode_workers; ++w)
+    {
+        encoders.emplace_back([&]()
+        {
+            try
+            {
+                for (std::size_t i {next_block.fetch_add(1)}; i < blocks.size(); i = next_block.fetch_add(1))
+                {
+                    {
+                        std::unique_lock<std::mutex> lock {window_mutex};
+                        window_moved.wait(lock, [&]() { return aborted or i < written + pipeline_options.queue_capacity; });
+                        if (aborted)
+                            break;
+                    }
+
+                    const ScopedSpan span {instrumentation, "encode"};
+                    std::string text;
+                    const auto [first, last] = blocks[i];
+                    for (std::size_t face {first}; face < last; ++face)
+                    {
+                        BRepLib_ToolTriangulatedShape::ComputeNormals(faces[face], triangulations[face].poly_tri);
+                        append_stl_facets(text, triangulations[face], format, normals);
+                    }
+
+                    EncodedBlock block {i, {}};
+                    if (gzip)
+                        gzip_member(text.data(), text.size(), block.bytes);
+                    else
+                        block.bytes = std::move(text);
+                    if (!block_queue.push(std::move(block)))
+                        break;
+                }
+            }
+            catch (...)
+            {
+                fail_encoding();
+            }
+
+            if (encoding.fetch_sub(1) == 1)
+                block_queue.close();
+        });
+    }
+
+    // Write, on this thread, in face order.
+    try
+    {
+        const ScopedSpan span {instrumentation, "write stl"};
+
+        std::ofstream f {stl_filepath, std::ios::binary};
+        assert(f.good());
+        std::size_t bytes_written {0};
+        const auto emit = [&f, &bytes_written, gzip](const std::string& bytes)
+        {
+            if (!gzip)
+            {
+                f.write(bytes.data(), bytes.size());
+                bytes_written += bytes.size();
+                return;
+            }
+            std::string member;
+            gzip_member(bytes.data(), bytes.size(), member);
+            f.write(member.data(), member.size());
+            bytes_written += member.size();
+        };
+
+        emit(stl_header(solid_name, format, static_cast<uint32_t>(triangles)));
+
+        std::map<std::size_t, std::string> waiting;
+        while (std::optional<EncodedBlock> block {block_queue.pop()})
+        {
+            waiting.emplace(block->sequence, std::move(block->bytes));
+            for (auto it {waiting.find(written)}; it != waiting.end(); it = waiting.find(written))
+            {
+                f.write(it->second.data(), it->second.size());
+                bytes_written += it->second.size();
+                waiting.erase(it);
+                {
+                    const std::lock_guard<std::mutex> lock {window_mutex};
+                    ++written;
+                }
+                window_moved.notify_all();
+            }
+        }
+
+        const std::string trailer {stl_trailer(solid_name, format)};
+        if (!trailer.empty())
+            emit(trailer);
+        assert(f.good());
+
+        if (instrumentation)
+            instrumentation->add_to_counter("bytes written", bytes_written);
+    }
+    catch (...)
+    {
+        fail_encoding();
+    }
+
+    for (std::thread& t : encoders)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+
+    return result;
+}
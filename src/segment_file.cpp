@@ -0,0 +1,526 @@
+// Standard library.
+#include <string>
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <utility>
+#include <algorithm>
+#include <cstring>
+#include <cassert>
+#include <stdexcept>
+#include <bit>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "gp_Dir.hxx"
+#include "gp_Ax2.hxx"
+#include "Geom_BSplineCurve.hxx"
+#include "Geom_Circle.hxx"
+#include "Geom_TrimmedCurve.hxx"
+#include "TColgp_Array1OfPnt.hxx"
+#include "TColStd_Array1OfReal.hxx"
+#include "TColStd_Array1OfInteger.hxx"
+
+// Library public.
+#include "geometric_primitives.hxx"
+#include "toolpath.hxx"
+#include "segment_file.hxx"
+#include "segment_list.hxx"
+#include "gcode.hxx"
+
+// Library private.
+#include "segment_file_p.hxx"
+#include "mapped_file_p.hxx"
+
+// Records are used in place, so the byte order of the file must be that of
+//     the host.
+static_assert(std::endian::native == std::endian::little);
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Doubles stored after the B-spline of an arc: the circle and the trimming
+//     parameters. Circles have all but the trimming parameters.
+const std::size_t ARC_SIDE_COUNT {12};
+const std::size_t CIRCLE_SIDE_COUNT {10};
+
+static Point3D to_point3d(const gp_Pnt& p);
+
+static std::size_t side_count(const SegmentRecord& record);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+static Point3D to_point3d(const gp_Pnt& p)
+{
+    return {p.X(), p.Y(), p.Z()};
+}
+
+/*
+    The number of doubles that a record keeps in the side table.
+*/
+static std::size_t side_count(const SegmentRecord& record)
+{
+    std::size_t count {3 * std::size_t {record.pole_count} + 2 * std::size_t {record.knot_count}};
+    if (record.flags & SEGMENT_RATIONAL)
+        count += record.pole_count;
+    if (record.kind == SegmentKind::arc)
+        count += ARC_SIDE_COUNT;
+    else if (record.kind == SegmentKind::circle)
+        count += CIRCLE_SIDE_COUNT;
+    return count;
+}
+
+void SegmentFileContents::add_to_bounds(const Point3D& p)
+{
+    for (int i {0}; i < 3; ++i)
+    {
+        this->bounds_min[i] = std::min(this->bounds_min[i], p[i]);
+        this->bounds_max[i] = std::max(this->bounds_max[i], p[i]);
+    }
+}
+
+/*
+    Writes the header, the records and the side table through a mapping of the
+        file. Even if the file already exists, it is completely overwritten.
+*/
+void SegmentFileContents::write(const std::string& filepath) const
+{
+    SegmentFileHeader header {};
+    header.magic = SEGMENT_FILE_MAGIC;
+    header.version = SEGMENT_FILE_VERSION;
+    header.record_bytes = sizeof(SegmentRecord);
+    header.segment_count = this->records.size();
+    header.side_count = this->side.size();
+    header.kind_counts = this->kind_counts;
+    header.bounds_min = this->bounds_min;
+    header.bounds_max = this->bounds_max;
+
+    const std::size_t record_bytes {sizeof(SegmentRecord) * this->records.size()};
+    const std::size_t side_bytes {sizeof(double) * this->side.size()};
+    const MappedFile file {filepath, sizeof(header) + record_bytes + side_bytes};
+
+    char* out {file.data()};
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    if (record_bytes > 0)
+        std::memcpy(out, this->records.data(), record_bytes);
+    out += record_bytes;
+    if (side_bytes > 0)
+        std::memcpy(out, this->side.data(), side_bytes);
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    Opens a segment file and checks that it is complete and of this version.
+
+    Arguments:
+        filepath: Absolute path to the file.
+
+    Throws:
+        std::runtime_error if the file can't be mapped, isn't a segment file,
+            is of another version or is truncated.
+*/
+SegmentFile::SegmentFile(const std::string& filepath)
+    : file(std::make_unique<MappedFile>(filepath))
+{
+    if (this->file->size() < sizeof(SegmentFileHeader))
+        throw std::runtime_error(filepath + " is not a segment file");
+
+    const auto* const header {reinterpret_cast<const SegmentFileHeader*>(this->file->data())};
+    if (header->magic != SEGMENT_FILE_MAGIC)
+        throw std::runtime_error(filepath + " is not a segment file");
+    if (header->version != SEGMENT_FILE_VERSION or header->record_bytes != sizeof(SegmentRecord))
+        throw std::runtime_error(filepath + " is a segment file of version " + std::to_string(header->version) +
+                                 ", but only version " + std::to_string(SEGMENT_FILE_VERSION) + " is supported");
+
+    const std::size_t expected {sizeof(SegmentFileHeader) +
+                                sizeof(SegmentRecord) * header->segment_count +
+                                sizeof(double) * header->side_count};
+    if (this->file->size() != expected)
+        throw std::runtime_error(filepath + " is truncated or corrupt");
+}
+
+SegmentFile::~SegmentFile() = default;
+
+SegmentFile::SegmentFile(SegmentFile&&) noexcept = default;
+
+SegmentFile& SegmentFile::operator=(SegmentFile&&) noexcept = default;
+
+uint32_t SegmentFile::version() const
+{
+    return reinterpret_cast<const SegmentFileHeader*>(this->file->data())->version;
+}
+
+std::size_t SegmentFile::segment_count() const
+{
+    return reinterpret_cast<const SegmentFileHeader*>(this->file->data())->segment_count;
+}
+
+/*
+    Returns:
+        The corners of a box around every segment, (min, max). The box holds
+            the control points of the curves, so it may be a little larger
+            than the curves themselves. The tool isn't included.
+*/
+std::pair<Point3D, Point3D> SegmentFile::bounds() const
+{
+    const auto* const header {reinterpret_cast<const SegmentFileHeader*>(this->file->data())};
+    return {header->bounds_min, header->bounds_max};
+}
+
+/*
+    Restores the segments of the file, ready for ToolPath::ToolPath().
+
+    Notes:
+        Within each kind, segments come back in the order they were written.
+        The vectors are sized up front from the header.
+
+    Throws:
+        std::runtime_error if a record refers to data outside of the file.
+
+    Returns:
+        The segments.
+*/
+SegmentCompound SegmentFile::segments() const
+{
+    const auto* const header {reinterpret_cast<const SegmentFileHeader*>(this->file->data())};
+
+    SegmentCompound compound;
+    std::get<0>(compound).reserve(header->kind_counts[0]);
+    std::get<1>(compound).reserve(header->kind_counts[1]);
+    std::get<2>(compound).reserve(header->kind_counts[2]);
+    std::get<3>(compound).reserve(header->kind_counts[3]);
+
+    for (std::size_t i {0}; i < header->segment_count; ++i)
+        std::visit([&compound](auto&& s)
+                   {
+                       std::get<std::vector<std::decay_t<decltype(s)>>>(compound).push_back(std::move(s));
+                   },
+                   decode_segment(i));
+
+    return compound;
+}
+
+/*
+    Restores the segments of the file in the order they were written, which is
+        program order for files made by convert_gcode().
+
+    Throws:
+        As segments().
+
+    Returns:
+        The segments.
+*/
+SegmentList SegmentFile::segment_list() const
+{
+    SegmentList segments;
+    segments.reserve(this->segment_count());
+    for (std::size_t i {0}; i < this->segment_count(); ++i)
+        segments.push_back(decode_segment(i));
+    return segments;
+}
+
+/*
+    Restores one segment of the file.
+
+    Arguments:
+        i: Index of the segment among all the segments of the file.
+
+    Throws:
+        std::runtime_error if the record refers to data outside of the file or
+            is of an unknown kind.
+*/
+Segment SegmentFile::decode_segment(const std::size_t i) const
+{
+    const auto* const header {reinterpret_cast<const SegmentFileHeader*>(this->file->data())};
+    const auto* const records {reinterpret_cast<const SegmentRecord*>(this->file->data() + sizeof(SegmentFileHeader))};
+
+    const SegmentRecord& record {records[i]};
+    if (record.kind != SegmentKind::line and
+        (record.side_offset > header->side_count or side_count(record) > header->side_count - record.side_offset))
+        throw std::runtime_error("Segment " + std::to_string(i) + " of the segment file is corrupt");
+
+    switch (record.kind)
+    {
+    case SegmentKind::line:
+        return Line {record.first, record.second};
+    case SegmentKind::arc:
+    {
+        ArcOfCircle arc;
+        decode_curve(record, arc);
+        return arc;
+    }
+    case SegmentKind::interpolated:
+    {
+        InterpolatedCurve curve;
+        decode_curve(record, curve);
+        return curve;
+    }
+    case SegmentKind::circle:
+    {
+        Circle circle;
+        decode_curve(record, circle);
+        return circle;
+    }
+    default:
+        throw std::runtime_error("Segment " + std::to_string(i) + " of the segment file is of an unknown kind");
+    }
+}
+
+/*
+    Rebuilds the B-spline of a curve, and the exact circle of arcs and
+        circles, from the side table. See SegmentRecord for the layout.
+*/
+void SegmentFile::decode_curve(const SegmentRecord& record, Curve& curve) const
+{
+    const auto* const header {reinterpret_cast<const SegmentFileHeader*>(this->file->data())};
+    const double* side {reinterpret_cast<const double*>(this->file->data() + sizeof(SegmentFileHeader) +
+                                                        sizeof(SegmentRecord) * header->segment_count)};
+    side += record.side_offset;
+
+    const int pole_count {static_cast<int>(record.pole_count)};
+    const int knot_count {static_cast<int>(record.knot_count)};
+
+    TColgp_Array1OfPnt poles(1, pole_count);
+    for (int i {1}; i <= pole_count; ++i, side += 3)
+        poles.SetValue(i, gp_Pnt(side[0], side[1], side[2]));
+
+    const bool rational {(record.flags & SEGMENT_RATIONAL) != 0};
+    TColStd_Array1OfReal weights(1, rational ? pole_count : 1);
+    if (rational)
+        for (int i {1}; i <= pole_count; ++i)
+            weights.SetValue(i, *side++);
+
+    TColStd_Array1OfReal knots(1, knot_count);
+    for (int i {1}; i <= knot_count; ++i)
+        knots.SetValue(i, *side++);
+
+    TColStd_Array1OfInteger multiplicities(1, knot_count);
+    for (int i {1}; i <= knot_count; ++i)
+        multiplicities.SetValue(i, static_cast<int>(*side++));
+
+    const bool periodic {(record.flags & SEGMENT_PERIODIC) != 0};
+    const int degree {static_cast<int>(record.degree)};
+    if (rational)
+        curve.representation = new Geom_BSplineCurve(poles, weights, knots, multiplicities, degree, periodic);
+    else
+        curve.representation = new Geom_BSplineCurve(poles, knots, multiplicities, degree, periodic);
+
+    if (record.kind != SegmentKind::arc and record.kind != SegmentKind::circle)
+        return;
+
+    const gp_Ax2 position {gp_Pnt(side[0], side[1], side[2]),
+                           gp_Dir(side[3], side[4], side[5]),
+                           gp_Dir(side[6], side[7], side[8])};
+    const Handle(Geom_Circle) circle {new Geom_Circle(position, side[9])};
+    if (record.kind == SegmentKind::arc)
+        curve.exact_representation = new Geom_TrimmedCurve(circle, side[10], side[11]);
+    else
+        curve.exact_representation = circle;
+}
+
+void SegmentFile::encode_line(const Line& line, SegmentFileContents& contents)
+{
+    SegmentRecord record {};
+    record.kind = SegmentKind::line;
+    record.first = line.start_point;
+    record.second = line.line;
+    contents.records.push_back(record);
+    ++contents.kind_counts[static_cast<std::size_t>(SegmentKind::line)];
+
+    contents.add_to_bounds(line.start_point);
+    contents.add_to_bounds({line.start_point[0] + line.line[0],
+                            line.start_point[1] + line.line[1],
+                            line.start_point[2] + line.line[2]});
+}
+
+/*
+    Stores the B-spline of a curve, and the exact circle of arcs and circles,
+        in the side table. See SegmentRecord for the layout.
+*/
+void SegmentFile::encode_curve(const Curve& curve,
+                               const uint32_t kind,
+                               SegmentFileContents& contents)
+{
+    const Handle(Geom_BSplineCurve)& bspline {curve.representation};
+    assert(!bspline.IsNull());
+
+    SegmentRecord record {};
+    record.kind = static_cast<SegmentKind>(kind);
+    record.flags = (bspline->IsRational() ? SEGMENT_RATIONAL : 0) | (bspline->IsPeriodic() ? SEGMENT_PERIODIC : 0);
+    record.first = to_point3d(bspline->StartPoint());
+    record.second = to_point3d(bspline->EndPoint());
+    record.degree = static_cast<uint32_t>(bspline->Degree());
+    record.pole_count = static_cast<uint32_t>(bspline->NbPoles());
+    record.knot_count = static_cast<uint32_t>(bspline->NbKnots());
+    record.side_offset = contents.side.size();
+
+    std::vector<double>& side {contents.side};
+    for (int i {1}; i <= bspline->NbPoles(); ++i)
+    {
+        const Point3D pole {to_point3d(bspline->Pole(i))};
+        side.insert(side.end(), pole.begin(), pole.end());
+        contents.add_to_bounds(pole);
+    }
+    if (bspline->IsRational())
+        for (int i {1}; i <= bspline->NbPoles(); ++i)
+            side.push_back(bspline->Weight(i));
+    for (int i {1}; i <= bspline->NbKnots(); ++i)
+        side.push_back(bspline->Knot(i));
+    for (int i {1}; i <= bspline->NbKnots(); ++i)
+        side.push_back(bspline->Multiplicity(i));
+
+    if (record.kind == SegmentKind::arc or record.kind == SegmentKind::circle)
+    {
+        Handle(Geom_TrimmedCurve) trimmed;
+        Handle(Geom_Circle) circle;
+        if (record.kind == SegmentKind::arc)
+        {
+            trimmed = Handle(Geom_TrimmedCurve)::DownCast(curve.exact_representation);
+            assert(!trimmed.IsNull());
+            circle = Handle(Geom_Circle)::DownCast(trimmed->BasisCurve());
+        }
+        else
+            circle = Handle(Geom_Circle)::DownCast(curve.exact_representation);
+        assert(!circle.IsNull());
+
+        const gp_Ax2& position {circle->Position()};
+        const gp_Pnt& center {position.Location()};
+        const gp_Dir& axis {position.Direction()};
+        const gp_Dir& x_axis {position.XDirection()};
+        side.insert(side.end(), {center.X(), center.Y(), center.Z(),
+                                 axis.X(), axis.Y(), axis.Z(),
+                                 x_axis.X(), x_axis.Y(), x_axis.Z(),
+                                 circle->Radius()});
+        if (record.kind == SegmentKind::arc)
+            side.insert(side.end(), {trimmed->FirstParameter(), trimmed->LastParameter()});
+    }
+
+    assert(side.size() - record.side_offset == side_count(record));
+    contents.records.push_back(record);
+    ++contents.kind_counts[kind];
+}
+
+/*
+    Stores segments kind by kind, in the order of the members of the compound.
+*/
+void SegmentFile::encode(const SegmentCompound& compound, SegmentFileContents& contents)
+{
+    for (const Line& line : std::get<0>(compound))
+        encode_line(line, contents);
+    for (const ArcOfCircle& arc : std::get<1>(compound))
+        encode_curve(arc, static_cast<uint32_t>(SegmentKind::arc), contents);
+    for (const InterpolatedCurve& curve : std::get<2>(compound))
+        encode_curve(curve, static_cast<uint32_t>(SegmentKind::interpolated), contents);
+    for (const Circle& circle : std::get<3>(compound))
+        encode_curve(circle, static_cast<uint32_t>(SegmentKind::circle), contents);
+}
+
+/*
+    Stores one segment after those already stored.
+*/
+void SegmentFile::encode(const Segment& segment, SegmentFileContents& contents)
+{
+    switch (segment.index())
+    {
+    case 0:
+        encode_line(std::get<Line>(segment), contents);
+        break;
+    case 1:
+        encode_curve(std::get<ArcOfCircle>(segment), static_cast<uint32_t>(SegmentKind::arc), contents);
+        break;
+    case 2:
+        encode_curve(std::get<InterpolatedCurve>(segment), static_cast<uint32_t>(SegmentKind::interpolated), contents);
+        break;
+    case 3:
+        encode_curve(std::get<Circle>(segment), static_cast<uint32_t>(SegmentKind::circle), contents);
+        break;
+    }
+}
+
+/*
+    Writes segments to a segment file. Even if the file already exists, it is
+        completely overwritten.
+
+    Arguments:
+        filepath: Absolute path to the file to write to.
+        compound: The segments. They are stored kind by kind, in the order of
+                      the members of the compound.
+
+    Returns:
+        None.
+*/
+void SegmentFile::write(const std::string& filepath, const SegmentCompound& compound)
+{
+    SegmentFileContents contents;
+    encode(compound, contents);
+    contents.write(filepath);
+}
+
+/*
+    Writes segments to a segment file, in the order of the list. See the
+        overload above.
+*/
+void SegmentFile::write(const std::string& filepath, const SegmentList& segments)
+{
+    SegmentFileContents contents;
+    contents.records.reserve(segments.size());
+    for (const Segment& segment : segments)
+        encode(segment, contents);
+    contents.write(filepath);
+}
+
+/*
+    Converts a G-code program into a segment file, one move at a time. The
+        segments are stored in program order. See parse_gcode_file() and
+        append_gcode_move() for how moves become segments.
+
+    Arguments:
+        gcode_filepath: Absolute path to the program.
+        filepath:       Absolute path to the segment file to write to.
+        include_rapids: Also store the rapid moves.
+
+    Throws:
+        As parse_gcode_file().
+
+    Returns:
+        None.
+*/
+void SegmentFile::convert_gcode(const std::string& gcode_filepath,
+                                const std::string& filepath,
+                                const bool include_rapids)
+{
+    SegmentFileContents contents;
+
+    // Holds the segment of one move at a time.
+    SegmentList move_segments;
+    parse_gcode_file(gcode_filepath,
+                     [&](const GcodeMove& move)
+                     {
+                         if (move.motion == GcodeMotion::rapid and !include_rapids)
+                             return;
+
+                         append_gcode_move(move, move_segments);
+                         for (const Segment& segment : move_segments)
+                             encode(segment, contents);
+                         move_segments.clear();
+                     });
+
+    contents.write(filepath);
+}
@@ -0,0 +1,58 @@
+// Standard library.
+#include <vector>
+#include <tuple>
+#include <variant>
+#include <utility>
+
+// Library public.
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+
+/*
+    The segment as its base class, for code that handles every kind alike.
+*/
+const Path& segment_path(const Segment& segment)
+{
+    return std::visit([](const Path& path) -> const Path& { return path; }, segment);
+}
+
+/*
+    Moves the segments of a compound into a list, kind by kind, in the order of
+        the members of the compound. The order between kinds is unknown, so
+        this is the order that ToolPath has always used for compounds.
+
+    Arguments:
+        compound: Emptied of its segments.
+*/
+SegmentList::SegmentList(SegmentCompound&& compound)
+{
+    this->list.reserve(std::get<0>(compound).size() + std::get<1>(compound).size() +
+                       std::get<2>(compound).size() + std::get<3>(compound).size());
+    std::apply([this](auto&... kinds)
+               {
+                   (..., [this](auto& segments)
+                         {
+                             for (auto& segment : segments)
+                                 this->list.emplace_back(std::move(segment));
+                             segments.clear();
+                         }(kinds));
+               },
+               compound);
+}
+
+/*
+    Copies the segments into a compound, for code that takes one. The order
+        within each kind is kept. Curves share their representations with
+        the list, so copying them is cheap.
+*/
+SegmentCompound SegmentList::to_compound() const
+{
+    SegmentCompound compound;
+    for (const Segment& segment : this->list)
+        std::visit([&compound](const auto& s)
+                   {
+                       std::get<std::vector<std::decay_t<decltype(s)>>>(compound).push_back(s);
+                   },
+                   segment);
+    return compound;
+}
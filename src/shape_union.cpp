@@ -0,0 +1,535 @@
+// Standard library.
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "Bnd_Box.hxx"
+#include "Bnd_OBB.hxx"
+#include "BRepBndLib.hxx"
+#include "BRepAlgoAPI_Fuse.hxx"
+#include "TopoDS_Shape.hxx"
+#include "TopoDS_Compound.hxx"
+#include "TopTools_ListOfShape.hxx"
+#include "BRep_Builder.hxx"
+#include "TopExp_Explorer.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "shape_union_p.hxx"
+#include "parallel_p.hxx"
+#include "instrumentation_p.hxx"
+
+/* 
+   ****************************************************************************
+                           File Local Declarations 
+   ****************************************************************************
+*/ 
+
+static gp_Pnt bounding_box_center(const TopoDS_Shape& s);
+
+static void kd_order(const std::vector<std::size_t>::iterator first,
+                     const std::vector<std::size_t>::iterator last,
+                     const std::vector<gp_Pnt>& centers);
+
+static std::size_t find_root(std::vector<std::size_t>& parents, std::size_t i);
+
+/* **************************************************************************** */
+
+
+/* 
+   ****************************************************************************
+                           File Local Definitions 
+   ****************************************************************************
+*/ 
+
+static gp_Pnt bounding_box_center(const TopoDS_Shape& s)
+{
+    Bnd_Box box;
+    BRepBndLib::Add(s, box);
+    if (box.IsVoid())
+        return gp_Pnt {0, 0, 0};
+
+    double x_min, y_min, z_min, x_max, y_max, z_max;
+    box.Get(x_min, y_min, z_min, x_max, y_max, z_max);
+    return gp_Pnt {(x_min + x_max) / 2, (y_min + y_max) / 2, (z_min + z_max) / 2};
+}
+
+/*
+    Orders a range of indices like the leaves of a balanced k-d tree. The range
+        is split at the median along the axis in which the centers are most
+        spread out, and each half is ordered recursively. Afterwards, indices
+        that are adjacent in the range refer to shapes that are close in space.
+
+    Arguments:
+        first:   Start of the range of indices into centers.
+        last:    End of the range of indices into centers.
+        centers: Bounding box centers of the shapes being ordered.
+*/
+static void kd_order(const std::vector<std::size_t>::iterator first,
+                     const std::vector<std::size_t>::iterator last,
+                     const std::vector<gp_Pnt>& centers)
+{
+    if (last - first <= 2)
+        return;
+
+    std::array<double, 3> lo;
+    std::array<double, 3> hi;
+    lo.fill(std::numeric_limits<double>::max());
+    hi.fill(std::numeric_limits<double>::lowest());
+    for (auto it {first}; it != last; ++it)
+    {
+        for (int axis {0}; axis < 3; ++axis)
+        {
+            lo[axis] = std::min(lo[axis], centers[*it].Coord(axis + 1));
+            hi[axis] = std::max(hi[axis], centers[*it].Coord(axis + 1));
+        }
+    }
+
+    int split_axis {0};
+    for (int axis {1}; axis < 3; ++axis)
+    {
+        if (hi[axis] - lo[axis] > hi[split_axis] - lo[split_axis])
+            split_axis = axis;
+    }
+
+    const auto middle {first + (last - first) / 2};
+    std::nth_element(first, middle, last, 
+                     [&](const std::size_t a, const std::size_t b)
+                     {
+                         return centers[a].Coord(split_axis + 1) < centers[b].Coord(split_axis + 1);
+                     });
+
+    kd_order(first, middle, centers);
+    kd_order(middle, last, centers);
+}
+
+/*
+    Finds the representative of the set containing i in a disjoint-set forest.
+        Compresses the path along the way.
+*/
+static std::size_t find_root(std::vector<std::size_t>& parents, std::size_t i)
+{
+    while (parents[i] != i)
+    {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+/* **************************************************************************** */
+
+/*
+    Counts the faces of a shape. Used to follow how the union grows.
+*/
+std::size_t count_faces(const TopoDS_Shape& s)
+{
+    std::size_t faces {0};
+    for (TopExp_Explorer face_it {s, TopAbs_FACE}; face_it.More(); face_it.Next())
+        ++faces;
+    return faces;
+}
+
+/*
+    Fuses two shapes into one.
+    
+    Arguments:
+        s1:              First shape.
+        s2:              Second shape.
+        span_name:       Name of the span that times the fuse, which tells
+                             what the fuse is part of.
+        counter_name:    Name of the counter that counts the fuse.
+        instrumentation: Records the fuse, if not null.
+
+    Returns:
+        The union of the two shapes.
+*/
+TopoDS_Shape fuse_pair(const TopoDS_Shape& s1, 
+                       const TopoDS_Shape& s2,
+                       const char* const span_name,
+                       const char* const counter_name,
+                       Instrumentation* const instrumentation)
+{
+    const ScopedSpan span {instrumentation, span_name};
+
+    BRepAlgoAPI_Fuse fuse {s1, s2};
+    assert(!fuse.HasErrors());
+
+    if (instrumentation)
+        instrumentation->add_to_counter(counter_name, 1);
+    return fuse.Shape();
+}
+
+/*
+    Fuses a collection of shapes by folding them, in order, into one growing
+        union.
+
+    Arguments:
+        shapes:          The shapes to fuse.
+        instrumentation: Records the fuses and the size of the union after each
+                             of them, if not null.
+
+    Returns:
+        The union of all of the shapes. A null shape if shapes is empty.
+*/
+TopoDS_Shape fuse_sequential(const std::vector<TopoDS_Shape>& shapes,
+                             Instrumentation* const instrumentation)
+{
+    if (shapes.empty())
+        return TopoDS_Shape {};
+
+    TopoDS_Shape result {shapes.front()};
+    for (auto it {shapes.begin() + 1}; it != shapes.end(); ++it)
+    {
+        result = fuse_pair(result, *it, "union fuse", "union booleans", instrumentation);
+        if (instrumentation)
+            instrumentation->sample_counter("union faces", count_faces(result));
+    }
+    return result;
+}
+
+/*
+    Computes an ordering of shapes in which neighbours in the ordering are
+        neighbours in space. Only the bounding box of each shape is considered.
+
+    Arguments:
+        shapes: The shapes to order.
+
+    Returns:
+        A permutation of the indices of shapes.
+*/
+std::vector<std::size_t> spatial_order(const std::vector<TopoDS_Shape>& shapes)
+{
+    std::vector<gp_Pnt> centers;
+    centers.reserve(shapes.size());
+    for (const TopoDS_Shape& s : shapes)
+        centers.push_back(bounding_box_center(s));
+
+    std::vector<std::size_t> order(shapes.size());
+    for (std::size_t i {0}; i < order.size(); ++i)
+        order[i] = i;
+
+    kd_order(order.begin(), order.end(), centers);
+    return order;
+}
+
+/*
+    Fuses a collection of shapes by reducing them in a balanced binary tree.
+        The shapes are first ordered spatially so that each fuse combines
+        shapes that are close to each other. Every level of the tree fuses
+        disjoint pairs, so the pairs of a level are fused concurrently.
+
+    Notes:
+        Compared to folding every shape into one growing union, no single fuse
+            sees more than its two subtrees. With n shapes this is log(n) levels
+            of fuses rather than n fuses against a union of size O(n).
+
+    Arguments:
+        shapes:  The shapes to fuse. 
+        threads: Maximum number of fuses to run at once. Zero means one per
+                     hardware thread.
+        instrumentation: Records the fuses and the size of each partial union,
+                             if not null.
+
+    Returns:
+        The union of all of the shapes. A null shape if shapes is empty.
+*/
+TopoDS_Shape fuse_tree_reduction(const std::vector<TopoDS_Shape>& shapes,
+                                 const unsigned int threads,
+                                 Instrumentation* const instrumentation)
+{
+    if (shapes.empty())
+        return TopoDS_Shape {};
+
+    std::vector<TopoDS_Shape> level;
+    level.reserve(shapes.size());
+    for (const std::size_t i : spatial_order(shapes))
+        level.push_back(shapes[i]);
+
+    while (level.size() > 1)
+    {
+        std::vector<TopoDS_Shape> next_level((level.size() + 1) / 2);
+
+        parallel_for(level.size() / 2, threads, 
+                     [&](const std::size_t i)
+                     {
+                         next_level[i] = fuse_pair(level[2 * i], level[2 * i + 1], "union fuse", "union booleans", instrumentation);
+                         if (instrumentation)
+                             instrumentation->sample_counter("union faces", count_faces(next_level[i]));
+                     });
+
+        // An odd shape out is carried up to the next level unchanged.
+        if (level.size() % 2 == 1)
+            next_level.back() = level.back();
+
+        level = std::move(next_level);
+    }
+
+    return level.front();
+}
+
+/*
+    Fuses a collection of shapes in a single Boolean operation. The first shape
+        is the object and every other shape is a tool, so the intersections
+        between all of the shapes are computed once by the general fuse
+        algorithm instead of once per pairwise fuse.
+
+    Arguments:
+        shapes:      The shapes to fuse.
+        fuzzy_value: Additional tolerance used when intersecting the shapes. 
+                         Zero disables fuzzy mode.
+        use_obb:     Filter out non-interfering pairs of sub-shapes using
+                         oriented bounding boxes before intersecting them.
+        instrumentation: Records the fuse and the size of the union, if not
+                             null.
+
+    Returns:
+        The union of all of the shapes. A null shape if shapes is empty.
+*/
+TopoDS_Shape fuse_general(const std::vector<TopoDS_Shape>& shapes,
+                          const double fuzzy_value,
+                          const bool use_obb,
+                          Instrumentation* const instrumentation)
+{
+    if (shapes.size() <= 1)
+        return shapes.empty() ? TopoDS_Shape {} : shapes.front();
+
+    TopTools_ListOfShape objects;
+    objects.Append(shapes.front());
+
+    TopTools_ListOfShape tools;
+    for (auto it {shapes.begin() + 1}; it != shapes.end(); ++it)
+        tools.Append(*it);
+
+    const ScopedSpan span {instrumentation, "general fuse"};
+
+    BRepAlgoAPI_Fuse fuse;
+    fuse.SetArguments(objects);
+    fuse.SetTools(tools);
+    fuse.SetRunParallel(true);
+    fuse.SetUseOBB(use_obb);
+    fuse.SetFuzzyValue(fuzzy_value);
+    fuse.Build();
+    assert(!fuse.HasErrors());
+
+    if (instrumentation)
+    {
+        instrumentation->add_to_counter("union booleans", 1);
+        instrumentation->sample_counter("union faces", count_faces(fuse.Shape()));
+    }
+    return fuse.Shape();
+}
+
+/*
+    Fuses a collection of shapes the way BuildOptions::union_mode asks for.
+
+    Arguments:
+        options:         Selects the union and its parameters.
+        shapes:          The shapes to fuse.
+        workers:         Maximum number of worker threads, for
+                             UnionMode::tree_reduction.
+        instrumentation: Records the fuses, if not null.
+
+    Returns:
+        The union of all of the shapes. A null shape if shapes is empty.
+*/
+TopoDS_Shape fuse_with_mode(const BuildOptions& options,
+                            const std::vector<TopoDS_Shape>& shapes,
+                            const unsigned int workers,
+                            Instrumentation* const instrumentation)
+{
+    switch (options.union_mode)
+    {
+        case UnionMode::tree_reduction:
+            return fuse_tree_reduction(shapes, workers, instrumentation);
+        case UnionMode::general_fuse:
+            return fuse_general(shapes, options.fuzzy_value, options.use_obb, instrumentation);
+        case UnionMode::sequential:
+        default:
+            return fuse_sequential(shapes, instrumentation);
+    }
+}
+
+/*
+    Groups shapes into clusters such that shapes in different clusters cannot
+        touch. Two shapes are linked when their bounding boxes overlap, and a
+        cluster is a connected component of the links.
+
+    Notes:
+        Candidate pairs come from a sweep-and-prune over axis-aligned bounding
+            boxes sorted along X, so only boxes whose X extents overlap are
+            ever compared.
+        The boxes are enlarged by FP_EQUALS_TOLERANCE so that shapes that only
+            touch end up in the same cluster.
+        Oriented bounding boxes are much tighter than axis-aligned ones around
+            diagonal sweeps. When requested, they are used to reject candidate
+            pairs that the axis-aligned boxes accept.
+
+    Arguments:
+        shapes:  The shapes to cluster.
+        use_obb: Confirm overlaps using oriented bounding boxes.
+        threads: Maximum number of threads used to compute the bounding boxes.
+                     Zero means one per hardware thread.
+
+    Returns:
+        The clusters, each a list of increasing indices into shapes. Clusters
+            are ordered by their first index.
+*/
+std::vector<std::vector<std::size_t>> overlapping_clusters(const std::vector<TopoDS_Shape>& shapes,
+                                                           const bool use_obb,
+                                                           const unsigned int threads)
+{
+    struct Bounds
+    {
+        Bnd_Box box;
+        Bnd_OBB obb;
+        double x_min;
+        double x_max;
+    };
+
+    std::vector<Bounds> bounds(shapes.size());
+    parallel_for(shapes.size(), threads, 
+                 [&](const std::size_t i)
+                 {
+                     BRepBndLib::Add(shapes[i], bounds[i].box);
+                     bounds[i].box.Enlarge(FP_EQUALS_TOLERANCE);
+                     if (use_obb)
+                     {
+                         BRepBndLib::AddOBB(shapes[i], bounds[i].obb);
+                         bounds[i].obb.Enlarge(FP_EQUALS_TOLERANCE);
+                     }
+
+                     double y_min, z_min, y_max, z_max;
+                     bounds[i].box.Get(bounds[i].x_min, y_min, z_min, bounds[i].x_max, y_max, z_max);
+                 });
+
+    std::vector<std::size_t> by_x_min(shapes.size());
+    for (std::size_t i {0}; i < by_x_min.size(); ++i)
+        by_x_min[i] = i;
+    std::sort(by_x_min.begin(), by_x_min.end(), 
+              [&](const std::size_t a, const std::size_t b)
+              {
+                  return bounds[a].x_min < bounds[b].x_min;
+              });
+
+    std::vector<std::size_t> parents(shapes.size());
+    for (std::size_t i {0}; i < parents.size(); ++i)
+        parents[i] = i;
+
+    // Boxes whose X extent still reaches the sweep position.
+    std::vector<std::size_t> active;
+    for (const std::size_t i : by_x_min)
+    {
+        std::erase_if(active, 
+                      [&](const std::size_t j)
+                      {
+                          return bounds[j].x_max < bounds[i].x_min;
+                      });
+
+        for (const std::size_t j : active)
+        {
+            if (bounds[i].box.IsOut(bounds[j].box))
+                continue;
+            if (use_obb and bounds[i].obb.IsOut(bounds[j].obb))
+                continue;
+            parents[find_root(parents, i)] = find_root(parents, j);
+        }
+
+        active.push_back(i);
+    }
+
+    // Number the clusters in order of their first member.
+    std::vector<std::vector<std::size_t>> clusters;
+    std::vector<std::size_t> cluster_of_root(shapes.size(), shapes.size());
+    for (std::size_t i {0}; i < shapes.size(); ++i)
+    {
+        const std::size_t root {find_root(parents, i)};
+        if (cluster_of_root[root] == shapes.size())
+        {
+            cluster_of_root[root] = clusters.size();
+            clusters.emplace_back();
+        }
+        clusters[cluster_of_root[root]].push_back(i);
+    }
+
+    return clusters;
+}
+
+/*
+    Fuses only the shapes that can touch each other. The shapes are split into
+        clusters with overlapping_clusters(), each cluster is fused on its own,
+        and the fused clusters are gathered into a compound without any Boolean
+        operation between them.
+
+    Notes:
+        Clusters are fused concurrently. The workers are shared evenly between
+            the clusters, so a program made of one big cluster still gets all of
+            them.
+
+    Arguments:
+        shapes:  The shapes to fuse.
+        use_obb: Confirm overlaps using oriented bounding boxes.
+        threads: Maximum number of worker threads. Zero means one per hardware
+                     thread.
+        fuse:    Fuses the shapes of one cluster using the given number of
+                     workers.
+        instrumentation: Records the time spent clustering and the number of
+                             clusters, if not null.
+
+    Returns:
+        The fused shape of the only cluster, or a compound of the fused shapes
+            of every cluster. A null shape if shapes is empty.
+*/
+TopoDS_Shape fuse_clusters(const std::vector<TopoDS_Shape>& shapes,
+                           const bool use_obb,
+                           const unsigned int threads,
+                           const std::function<TopoDS_Shape(const std::vector<TopoDS_Shape>&,
+                                                             const unsigned int)>& fuse,
+                           Instrumentation* const instrumentation)
+{
+    std::vector<std::vector<std::size_t>> clusters;
+    {
+        const ScopedSpan span {instrumentation, "clustering"};
+        clusters = overlapping_clusters(shapes, use_obb, threads);
+    }
+    if (instrumentation)
+        instrumentation->add_to_counter("clusters", clusters.size());
+    if (clusters.empty())
+        return TopoDS_Shape {};
+
+    const unsigned int workers {resolve_thread_count(threads)};
+    const unsigned int workers_per_cluster {std::max<unsigned int>(1, workers / clusters.size())};
+
+    std::vector<TopoDS_Shape> fused(clusters.size());
+    parallel_for(clusters.size(), workers, 
+                 [&](const std::size_t c)
+                 {
+                     std::vector<TopoDS_Shape> members;
+                     members.reserve(clusters[c].size());
+                     for (const std::size_t i : clusters[c])
+                         members.push_back(shapes[i]);
+                     fused[c] = fuse(members, workers_per_cluster);
+                 });
+
+    if (fused.size() == 1)
+        return fused.front();
+
+    BRep_Builder builder;
+    TopoDS_Compound compound;
+    builder.MakeCompound(compound);
+    for (const TopoDS_Shape& s : fused)
+        builder.Add(compound, s);
+
+    return compound;
+}
@@ -0,0 +1,405 @@
+// Standard library.
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cassert>
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+// Third party.
+
+// OCCT.
+#include "Poly_Triangulation.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "parallel_p.hxx"
+#include "facet_normals_p.hxx"
+#include "mesh_export_p.hxx"
+#include "compression_p.hxx"
+#include "instrumentation_p.hxx"
+
+/*
+   ****************************************************************************
+                           File Local Declarations
+   ****************************************************************************
+*/
+
+// Faces are formatted in blocks of roughly this many triangles. Each block is
+//     formatted by one worker into its own buffer and written with one call.
+const std::size_t STL_BLOCK_TRIANGLES {1 << 15};
+
+// Upper bound on the length of one formatted facet, used to size the buffers.
+const std::size_t ASCII_FACET_BYTES {320};
+
+// Layout of binary files.
+const std::size_t BINARY_HEADER_BYTES {80};
+const std::size_t BINARY_TRIANGLE_BYTES {50};
+
+static void load_face(const FaceTriangulation& face,
+                      const FacetNormals normals,
+                      FacetBatch& batch);
+
+static void append_ascii_facets(std::string& out, const FacetBatch& batch);
+
+static char* put_binary_facets(char* out, const FacetBatch& batch);
+
+/* **************************************************************************** */
+
+
+
+/*
+   ****************************************************************************
+                           File Local Definitions
+   ****************************************************************************
+*/
+
+/*
+    Loads the triangles of a face into a batch and computes their normals.
+        Vertex averaged normals keep the corners in their stored order, as
+        the exporters always have. Geometric normals follow the orientation of
+        the face.
+*/
+static void load_face(const FaceTriangulation& face,
+                      const FacetNormals normals,
+                      FacetBatch& batch)
+{
+    if (normals == FacetNormals::geometric)
+    {
+        load_facets(face.poly_tri, face.reversed, batch);
+        geometric_normals(batch);
+    }
+    else
+    {
+        load_facets(face.poly_tri, false, batch);
+        vertex_average_normals(face.poly_tri, batch);
+    }
+}
+
+/*
+    Appends the text encoding of every triangle of a batch.
+*/
+static void append_ascii_facets(std::string& out, const FacetBatch& batch)
+{
+    for (std::size_t i {0}; i < batch.size(); ++i)
+    {
+        // Write the face normals.
+        out += FOUR_SPACES;
+        out += "facet normal ";
+        append_number(out, batch.nx[i]);
+        out += ' ';
+        append_number(out, batch.ny[i]);
+        out += ' ';
+        append_number(out, batch.nz[i]);
+        out += '\n';
+
+        // Write the vertices.
+        out += EIGHT_SPACES;
+        out += "outer loop\n";
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            out += TWELVE_SPACES;
+            out += "vertex ";
+            append_number(out, batch.x[k][i]);
+            out += ' ';
+            append_number(out, batch.y[k][i]);
+            out += ' ';
+            append_number(out, batch.z[k][i]);
+            out += '\n';
+        }
+        out += EIGHT_SPACES;
+        out += "endloop\n";
+        out += FOUR_SPACES;
+        out += "endfacet\n";
+    }
+}
+
+/*
+    Encodes every triangle of a batch as a binary record.
+
+    Returns:
+        Where the record after the last one starts.
+*/
+static char* put_binary_facets(char* out, const FacetBatch& batch)
+{
+    for (std::size_t i {0}; i < batch.size(); ++i)
+    {
+        out = put_float32(out, static_cast<float>(batch.nx[i]));
+        out = put_float32(out, static_cast<float>(batch.ny[i]));
+        out = put_float32(out, static_cast<float>(batch.nz[i]));
+        for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+        {
+            out = put_float32(out, static_cast<float>(batch.x[k][i]));
+            out = put_float32(out, static_cast<float>(batch.y[k][i]));
+            out = put_float32(out, static_cast<float>(batch.z[k][i]));
+        }
+        // Attribute byte count. Unused.
+        out = put_uint16(out, 0);
+    }
+    return out;
+}
+
+/* **************************************************************************** */
+
+
+
+/*
+    What comes before the triangles of an .stl file. See write_binary_stl()
+        for the binary header.
+
+    Arguments:
+        triangles: Binary files only. Number of triangles in the file.
+*/
+std::string stl_header(const std::string& solid_name,
+                       const StlFormat format,
+                       const uint32_t triangles)
+{
+    if (format == StlFormat::ascii)
+        return "solid " + solid_name + "\n";
+
+    std::string header {"binary " + solid_name};
+    header.resize(BINARY_HEADER_BYTES, '\0');
+    header.resize(BINARY_HEADER_BYTES + sizeof(uint32_t));
+    put_uint32(header.data() + BINARY_HEADER_BYTES, triangles);
+    return header;
+}
+
+/*
+    What comes after the triangles of an .stl file. Empty for binary files.
+*/
+std::string stl_trailer(const std::string& solid_name, const StlFormat format)
+{
+    return format == StlFormat::ascii ? "endsolid " + solid_name : std::string {};
+}
+
+/*
+    Appends the triangles of one face, encoded as shape_to_stl() encodes them.
+        For writers that encode a face at a time.
+*/
+void append_stl_facets(std::string& out,
+                       const FaceTriangulation& face,
+                       const StlFormat format,
+                       const FacetNormals normals)
+{
+    // Reused by every face this thread encodes.
+    thread_local FacetBatch batch;
+    load_face(face, normals, batch);
+
+    if (format == StlFormat::ascii)
+    {
+        out.reserve(out.size() + batch.size() * ASCII_FACET_BYTES);
+        append_ascii_facets(out, batch);
+        return;
+    }
+
+    const std::size_t start {out.size()};
+    out.resize(start + BINARY_TRIANGLE_BYTES * batch.size());
+    put_binary_facets(out.data() + start, batch);
+}
+
+/*
+    Writes the meshed toolpath to a file. Even if the file already exists, it is
+        completely overwritten. Per-face normals are included in the .stl file.
+        By default, each per-face normal is computed by averaging whatever 
+        vertex normals are associated with the vertices of the face.
+    See https://www.fabbers.com/tech/STL_Format for the closest thing to a
+        standardization of the STL format.
+
+    Assumes:
+        (1) The caller is OK with the file being overwritten if it already exists.
+        (2) The toolpath has already been meshed in a satisfactory way.
+        (3) For FacetNormals::vertex_average, mesh_surface() computed vertex
+                normals.
+
+    Arguments:
+        solid_name: The desired name of the solid in the .stl file.
+        file_path:  Absolute path to the file to write to.
+        format:     Text or binary encoding. Binary files are roughly five
+                        times smaller and much faster to write and to read.
+        normals:    How the per-face normals are computed.
+
+    Returns:
+        None.
+*/
+void ToolPath::shape_to_stl(const std::string solid_name,
+                            const std::string filepath,
+                            const StlFormat format,
+                            const FacetNormals normals) const
+{
+    const ScopedSpan span {this->options.instrumentation, "write stl"};
+
+    if (format == StlFormat::binary)
+        write_binary_stl(solid_name, filepath, normals);
+    else
+        write_ascii_stl(solid_name, filepath, normals);
+}
+
+/*
+    Writes the meshed toolpath to a text .stl file.
+
+    Notes:
+        Numbers are formatted with std::to_chars rather than iostreams, and
+            the text is written a block of faces at a time, so the stream is
+            never flushed in between.
+        Blocks of faces are formatted concurrently, a wave of blocks at a time,
+            and written in face order. The file is the same whatever the number
+            of workers.
+        With BuildOptions::output_compression, each block is also compressed
+            by the worker that formatted it.
+
+    Arguments:
+        solid_name: The desired name of the solid in the .stl file.
+        file_path:  Absolute path to the file to write to.
+        normals:    How the per-face normals are computed.
+
+    Returns:
+        None.
+*/
+void ToolPath::write_ascii_stl(const std::string& solid_name,
+                               const std::string& filepath,
+                               const FacetNormals normals) const
+{
+    const std::vector<FaceTriangulation> triangulations {collect_triangulations(this->toolpath_shape_union)};
+
+    // Split the faces into blocks of consecutive faces.
+    std::vector<std::pair<std::size_t, std::size_t>> blocks;
+    std::size_t block_triangles {0};
+    for (std::size_t i {0}; i < triangulations.size(); ++i)
+    {
+        if (blocks.empty() or block_triangles >= STL_BLOCK_TRIANGLES)
+        {
+            blocks.emplace_back(i, i);
+            block_triangles = 0;
+        }
+        blocks.back().second = i + 1;
+        block_triangles += triangulations[i].poly_tri->NbTriangles();
+    }
+
+    std::ofstream f {filepath, std::ios::binary};
+    assert(f.good());
+
+    // With compression, every piece of text becomes its own gzip member.
+    const bool gzip {this->options.output_compression == Compression::gzip};
+    std::size_t bytes_written {0};
+    const auto emit = [&f, &bytes_written](const std::string& bytes)
+    {
+        f.write(bytes.data(), bytes.size());
+        bytes_written += bytes.size();
+    };
+
+    std::string member;
+    const std::string header {stl_header(solid_name, StlFormat::ascii)};
+    if (gzip)
+        gzip_member(header.data(), header.size(), member);
+    emit(gzip ? member : header);
+
+    // Only one wave of blocks is held in memory at a time. The buffers are
+    //     reused from wave to wave.
+    const std::size_t workers {resolve_thread_count(this->options.threads)};
+    std::vector<std::string> buffers(std::min(workers, blocks.size()));
+    std::vector<std::string> members(gzip ? buffers.size() : 0);
+    for (std::size_t wave_start {0}; wave_start < blocks.size(); wave_start += buffers.size())
+    {
+        const std::size_t wave_size {std::min(buffers.size(), blocks.size() - wave_start)};
+        parallel_for(wave_size, this->options.threads,
+                     [&](const std::size_t i)
+                     {
+                         const auto [first, last] = blocks[wave_start + i];
+                         std::string& out {buffers[i]};
+                         out.clear();
+
+                         std::size_t triangles {0};
+                         for (std::size_t face {first}; face < last; ++face)
+                             triangles += triangulations[face].poly_tri->NbTriangles();
+                         out.reserve(triangles * ASCII_FACET_BYTES);
+
+                         // Reused by every face this worker formats.
+                         thread_local FacetBatch batch;
+                         for (std::size_t face {first}; face < last; ++face)
+                         {
+                             load_face(triangulations[face], normals, batch);
+                             append_ascii_facets(out, batch);
+                         }
+
+                         if (gzip)
+                             gzip_member(out.data(), out.size(), members[i]);
+                     });
+
+        for (std::size_t i {0}; i < wave_size; ++i)
+            emit(gzip ? members[i] : buffers[i]);
+    }
+
+    const std::string trailer {stl_trailer(solid_name, StlFormat::ascii)};
+    if (gzip)
+        gzip_member(trailer.data(), trailer.size(), member);
+    emit(gzip ? member : trailer);
+    assert(f.good());
+
+    if (this->options.instrumentation)
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+}
+
+/*
+    Writes the meshed toolpath to a binary .stl file. The normals are computed
+        the same way as for the text encoding.
+
+    Notes:
+        Every record has the same size, so the place of each face in the file
+            is known up front. Faces are encoded concurrently, straight into 
+            the file mapping or into a buffer handed to the stream in a single
+            write, depending on BuildOptions::mapped_output.
+        The header holds the solid name, truncated to fit. It never starts with
+            "solid", which would make some readers mistake the file for text.
+
+    Arguments:
+        solid_name: Stored in the 80 byte header.
+        file_path:  Absolute path to the file to write to.
+        normals:    How the per-face normals are computed.
+
+    Returns:
+        None.
+*/
+void ToolPath::write_binary_stl(const std::string& solid_name,
+                                const std::string& filepath,
+                                const FacetNormals normals) const
+{
+    const std::vector<FaceTriangulation> triangulations {collect_triangulations(this->toolpath_shape_union)};
+
+    // The first triangle of each face, counting from the start of the file.
+    std::vector<std::size_t> first_triangles(triangulations.size());
+    std::size_t triangles {0};
+    for (std::size_t i {0}; i < triangulations.size(); ++i)
+    {
+        first_triangles[i] = triangles;
+        triangles += triangulations[i].poly_tri->NbTriangles();
+    }
+    assert(triangles <= std::numeric_limits<uint32_t>::max());
+
+    const std::string header {stl_header(solid_name, StlFormat::binary, static_cast<uint32_t>(triangles))};
+    const std::size_t records_start {header.size()};
+    const std::size_t size {records_start + BINARY_TRIANGLE_BYTES * triangles};
+
+    const auto fill = [&](char* const file)
+    {
+        std::copy(header.begin(), header.end(), file);
+
+        parallel_for(triangulations.size(), this->options.threads,
+                     [&](const std::size_t face)
+                     {
+                         // Reused by every face this worker encodes.
+                         thread_local FacetBatch batch;
+                         load_face(triangulations[face], normals, batch);
+
+                         put_binary_facets(file + records_start + BINARY_TRIANGLE_BYTES * first_triangles[face], batch);
+                     });
+    };
+    const std::size_t bytes_written {write_output(filepath, size, this->options, fill)};
+
+    if (this->options.instrumentation)
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+}
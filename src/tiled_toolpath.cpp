@@ -0,0 +1,341 @@
+// Standard library.
+#include <string>
+#include <vector>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include <cassert>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "BRepPrimAPI_MakeBox.hxx"
+#include "BRepAlgoAPI_Common.hxx"
+#include "TopoDS_Shape.hxx"
+#include "TopExp_Explorer.hxx"
+#include "TopTools_ListOfShape.hxx"
+#include "TopTools_ListIteratorOfListOfShape.hxx"
+#include "TopTools_MapOfShape.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "segment_list.hxx"
+#include "tiled_toolpath.hxx"
+#include "instrumentation.hxx"
+
+// Library private.
+#include "util_p.hxx"
+#include "parallel_p.hxx"
+#include "mesh_export_p.hxx"
+#include "instrumentation_p.hxx"
+
+/*
+    Builds a toolpath tile by tile.
+
+    Notes:
+        The XY extent of the toolpath is split into grid.columns by grid.rows
+            equal cells. A segment belongs to every cell that the box around
+            what the tool sweeps along it reaches into. Each tile is built
+            from the segments of its cell, in the order of the list, then
+            clipped to the cell. The outer sides of the grid are pushed out of
+            the way, so only the seams between cells cut anything.
+        Arc fitting and coalescing are done once on the whole list, before the
+            segments are split between cells, so that both sides of a seam
+            sweep the same segments.
+        Segments that cross a seam are swept once for every cell they reach.
+        Cells that no segment reaches have no tile.
+
+    Arguments:
+        segments: The segments that make up the toolpath, in order.
+        profile:  The cross section of the tool.
+        grid:     How many cells the extent is split into along X and Y.
+        options:  As for ToolPath::ToolPath(). Tiles are built concurrently, on
+                      BuildOptions::threads workers, and each tile is built on
+                      a single thread.
+*/
+TiledToolPath::TiledToolPath(const SegmentList& segments,
+                             const CylindricalTool& profile,
+                             const TileGrid& grid,
+                             const BuildOptions& options)
+    : options(options)
+{
+    assert(grid.columns > 0 and grid.rows > 0);
+
+    Instrumentation* const instrumentation {options.instrumentation};
+    const ScopedSpan build_span {instrumentation, "tiled build"};
+
+    const SegmentList* source {&segments};
+    SegmentList fitted;
+    if (options.arc_fitting_tolerance > 0)
+    {
+        const ScopedSpan span {instrumentation, "fit arcs"};
+        fitted = ToolPath::fit_arcs(*source, options.arc_fitting_tolerance, this->arc_fitting_error);
+        source = &fitted;
+    }
+    SegmentList coalesced;
+    if (options.coalesce_segments)
+    {
+        const ScopedSpan span {instrumentation, "coalesce"};
+        coalesced = ToolPath::coalesce(*source, options.coalesce_tolerance);
+        source = &coalesced;
+    }
+    if (source->empty())
+        return;
+
+    // The box around what the tool sweeps along each segment, and around the
+    //     whole toolpath.
+    std::vector<std::pair<Point3D, Point3D>> bounds(source->size());
+    Point3D low {std::numeric_limits<double>::max(), std::numeric_limits<double>::max(), std::numeric_limits<double>::max()};
+    Point3D high {std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+    for (std::size_t i {0}; i < source->size(); ++i)
+    {
+        auto& [segment_low, segment_high] = bounds[i];
+        std::tie(segment_low, segment_high) = ToolPath::segment_bounds(segment_path((*source)[i]));
+        segment_low[0] -= profile.radius;
+        segment_low[1] -= profile.radius;
+        segment_high[0] += profile.radius;
+        segment_high[1] += profile.radius;
+        segment_high[2] += profile.height;
+        for (int k {0}; k < 3; ++k)
+        {
+            low[k] = std::min(low[k], segment_low[k]);
+            high[k] = std::max(high[k], segment_high[k]);
+        }
+    }
+
+    // Where the cells start and end along X and Y.
+    const double margin {1 + std::max({high[0] - low[0], high[1] - low[1], high[2] - low[2]})};
+    const double width {(high[0] - low[0]) / grid.columns};
+    const double depth {(high[1] - low[1]) / grid.rows};
+    std::vector<double> xs(grid.columns + 1);
+    std::vector<double> ys(grid.rows + 1);
+    for (unsigned int c {0}; c <= grid.columns; ++c)
+        xs[c] = low[0] + width * c;
+    for (unsigned int r {0}; r <= grid.rows; ++r)
+        ys[r] = low[1] + depth * r;
+    xs.front() -= margin;
+    xs.back() += margin;
+    ys.front() -= margin;
+    ys.back() += margin;
+
+    // The cell holding a coordinate, along one axis.
+    const auto cell_index = [](const double value, const double start, const double size, const unsigned int count)
+    {
+        const double index {std::floor((value - start) / size)};
+        return static_cast<unsigned int>(std::clamp(index, 0.0, static_cast<double>(count - 1)));
+    };
+
+    const std::size_t cell_count {static_cast<std::size_t>(grid.columns) * grid.rows};
+    std::vector<std::vector<std::size_t>> members(cell_count);
+    for (std::size_t i {0}; i < source->size(); ++i)
+    {
+        const auto& [segment_low, segment_high] = bounds[i];
+        const unsigned int first_column {cell_index(segment_low[0], low[0], width, grid.columns)};
+        const unsigned int last_column {cell_index(segment_high[0], low[0], width, grid.columns)};
+        const unsigned int first_row {cell_index(segment_low[1], low[1], depth, grid.rows)};
+        const unsigned int last_row {cell_index(segment_high[1], low[1], depth, grid.rows)};
+        for (unsigned int r {first_row}; r <= last_row; ++r)
+            for (unsigned int c {first_column}; c <= last_column; ++c)
+                members[static_cast<std::size_t>(r) * grid.columns + c].push_back(i);
+    }
+
+    BuildOptions tile_options {options};
+    tile_options.threads = 1;
+    tile_options.arc_fitting_tolerance = 0;
+    tile_options.coalesce_segments = false;
+
+    std::vector<std::optional<ToolPath>> built(cell_count);
+    std::vector<std::vector<bool>> built_seam_faces(cell_count);
+    parallel_for(cell_count, options.threads,
+                 [&](const std::size_t cell)
+                 {
+                     if (members[cell].empty())
+                         return;
+                     const ScopedSpan span {instrumentation, "tile", static_cast<int64_t>(cell)};
+
+                     SegmentList tile_segments;
+                     tile_segments.reserve(members[cell].size());
+                     for (const std::size_t i : members[cell])
+                         tile_segments.push_back(Segment {(*source)[i]});
+                     ToolPath tile {tile_segments, profile, false, tile_options};
+
+                     const std::size_t row {cell / grid.columns};
+                     const std::size_t column {cell % grid.columns};
+                     const TopoDS_Shape box {BRepPrimAPI_MakeBox {gp_Pnt {xs[column], ys[row], low[2] - margin},
+                                                                  gp_Pnt {xs[column + 1], ys[row + 1], high[2] + margin}}.Shape()};
+                     BRepAlgoAPI_Common common {tile.toolpath_shape_union, box};
+                     assert(!common.HasErrors());
+                     tile.toolpath_shape_union = common.Shape();
+
+                     // The faces of the clipped tile that come from the box.
+                     TopTools_MapOfShape cut_faces;
+                     for (TopExp_Explorer face_it {box, TopAbs_FACE}; face_it.More(); face_it.Next())
+                     {
+                         const TopoDS_Shape& face {face_it.Current()};
+                         if (common.IsDeleted(face))
+                             continue;
+                         const TopTools_ListOfShape& images {common.Modified(face)};
+                         if (images.IsEmpty())
+                             cut_faces.Add(face);
+                         for (TopTools_ListIteratorOfListOfShape image_it {images}; image_it.More(); image_it.Next())
+                             cut_faces.Add(image_it.Value());
+                     }
+                     for (TopExp_Explorer face_it {tile.toolpath_shape_union, TopAbs_FACE}; face_it.More(); face_it.Next())
+                         built_seam_faces[cell].push_back(cut_faces.Contains(face_it.Current()));
+
+                     built[cell].emplace(std::move(tile));
+                 });
+
+    for (std::size_t cell {0}; cell < cell_count; ++cell)
+    {
+        if (!built[cell])
+            continue;
+        const std::size_t row {cell / grid.columns};
+        const std::size_t column {cell % grid.columns};
+        this->tiles.push_back(std::move(*built[cell]));
+        this->cells.push_back({{xs[column], ys[row], low[2]}, {xs[column + 1], ys[row + 1], high[2]}});
+        this->seam_faces.push_back(std::move(built_seam_faces[cell]));
+    }
+
+    if (instrumentation)
+        instrumentation->add_to_counter("tiles", this->tiles.size());
+}
+
+std::size_t TiledToolPath::tile_count() const
+{
+    return this->tiles.size();
+}
+
+/*
+    One tile, as a toolpath of its own, for consumers that work a region at a
+        time. Its shape is closed by flat faces where its cell ends.
+*/
+const ToolPath& TiledToolPath::tile(const std::size_t i) const
+{
+    assert(i < this->tiles.size());
+    return this->tiles[i];
+}
+
+/*
+    The cell of a tile, as its lowest and its highest corner. The cells on the
+        edges of the grid reach further out than the toolpath.
+*/
+std::pair<Point3D, Point3D> TiledToolPath::tile_bounds(const std::size_t i) const
+{
+    assert(i < this->cells.size());
+    return this->cells[i];
+}
+
+/*
+    See ToolPath::approximation_error().
+*/
+double TiledToolPath::approximation_error() const
+{
+    return this->arc_fitting_error;
+}
+
+/*
+    Meshes every tile, concurrently. See ToolPath::mesh_surface().
+
+    Notes:
+        The deflection is also how far a vertex of one side of a seam may lie
+            from an edge of the other side and still be stitched into it.
+*/
+void TiledToolPath::mesh_surface(const double angle,
+                                 const double deflection,
+                                 const bool vertex_normals)
+{
+    this->mesh_buffers = std::make_shared<MeshBuffers>();
+    this->seam_tolerance = deflection;
+
+    parallel_for(this->tiles.size(), this->options.threads,
+                 [&](const std::size_t i)
+                 {
+                     this->tiles[i].mesh_surface(angle, deflection, vertex_normals);
+                 });
+}
+
+/*
+    Stitches the meshes of the tiles into one mesh of the whole toolpath.
+
+    Notes:
+        The faces that close the tiles at the seams are left out. The tiles are
+            meshed apart, so the two sides of a seam may not have vertices in
+            the same places. See close_t_junctions().
+        Face ids count on from tile to tile, in tile order.
+*/
+IndexedMesh TiledToolPath::stitched_mesh(const double weld_tolerance) const
+{
+    const ScopedSpan span {this->options.instrumentation, "stitch"};
+
+    std::vector<FaceTriangulation> triangulations;
+    uint32_t first_face_id {0};
+    for (std::size_t i {0}; i < this->tiles.size(); ++i)
+    {
+        for (FaceTriangulation& face : collect_triangulations(this->tiles[i].toolpath_shape_union))
+        {
+            if (this->seam_faces[i][face.face_id])
+                continue;
+            face.face_id += first_face_id;
+            triangulations.push_back(std::move(face));
+        }
+        first_face_id += static_cast<uint32_t>(this->seam_faces[i].size());
+    }
+
+    IndexedMesh mesh {weld_triangulations(triangulations, weld_tolerance)};
+    if (this->tiles.size() > 1 and this->seam_tolerance > 0)
+    {
+        const std::size_t inserted {close_t_junctions(mesh, this->seam_tolerance)};
+        if (this->options.instrumentation)
+            this->options.instrumentation->add_to_counter("seam vertices inserted", inserted);
+    }
+    return mesh;
+}
+
+/*
+    The stitched mesh of the whole toolpath. See ToolPath::mesh_view().
+
+    Assumes:
+        (1) The tiles have already been meshed with mesh_surface().
+*/
+MeshView TiledToolPath::mesh_view() const
+{
+    if (!this->mesh_buffers)
+        return MeshView {};
+
+    MeshBuffers& buffers {*this->mesh_buffers};
+    std::call_once(buffers.built,
+                   [&]()
+                   {
+                       buffers.mesh = stitched_mesh(DEFAULT_WELD_TOLERANCE);
+                       buffers.normals = vertex_normals(buffers.mesh);
+                   });
+
+    return {buffers.mesh.positions, buffers.normals, buffers.mesh.indices, buffers.mesh.face_ids};
+}
+
+/*
+    Writes the stitched mesh of the whole toolpath to a binary .ply file. See
+        ToolPath::shape_to_ply(). To write the tiles apart, use the exporters
+        of tile().
+*/
+void TiledToolPath::shape_to_ply(const std::string filepath,
+                                 const double weld_tolerance) const
+{
+    const ScopedSpan span {this->options.instrumentation, "write ply"};
+
+    const IndexedMesh mesh {stitched_mesh(weld_tolerance)};
+    const std::size_t bytes_written {write_ply(filepath, mesh, this->options)};
+
+    if (this->options.instrumentation)
+    {
+        this->options.instrumentation->add_to_counter("welded vertices", mesh.vertex_count());
+        this->options.instrumentation->add_to_counter("bytes written", bytes_written);
+    }
+}
@@ -1,8 +1,9 @@
 // Standard library.
 #include <vector>
-#include <fstream>
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
+#include <memory>
 
 // Third party.
 
@@ -16,10 +17,15 @@
 #include "BRepBuilderAPI_MakeFace.hxx"
 #include "BRepBuilderAPI_MakeEdge.hxx"
 #include "BRepBuilderAPI_MakeWire.hxx"
+#include "GC_MakeArcOfCircle.hxx"
+#include "Geom_TrimmedCurve.hxx"
+#include "Geom_Circle.hxx"
+#include "gp_Ax1.hxx"
 #include "BRepOffsetAPI_MakePipe.hxx"
 #include "BRepAlgoAPI_Fuse.hxx"
 #include "BRepPrimAPI_MakeCylinder.hxx"
 #include "BRepPrimAPI_MakePrism.hxx"
+#include "BRepPrimAPI_MakeRevol.hxx"
 #include "BRepMesh_IncrementalMesh.hxx"
 #include "BRep_Tool.hxx"
 #include "BRepTools.hxx"
@@ -35,9 +41,15 @@
 
 // Library public.
 #include "toolpath.hxx"
+#include "segment_list.hxx"
+#include "instrumentation.hxx"
 
 // Library private.
 #include "util_p.hxx"
+#include "shape_union_p.hxx"
+#include "mesh_export_p.hxx"
+#include "parallel_p.hxx"
+#include "instrumentation_p.hxx"
 #include "glfw_occt_view_p.hxx"
 
 /* 
@@ -51,7 +63,18 @@ static TopoDS_Face construct_rect_face(const gp_Dir normal,
                                        const double width, 
                                        const double height);
 
-static gp_Dir compute_average_vec(const std::vector<gp_Vec>& vecs);
+static bool is_closed_segment(const Path& segment);
+
+static bool same_point(const Point3D& p1, const Point3D& p2);
+
+static TopoDS_Face construct_stadium_face(const gp_Pnt& start,
+                                          const gp_Pnt& end,
+                                          const double radius);
+
+static bool circular_sweep(const Handle(Geom_Curve)& exact, 
+                           const double tool_radius,
+                           gp_Ax1& axis,
+                           double& angle);
 
 /* **************************************************************************** */
 
@@ -181,18 +204,126 @@ static TopoDS_Face construct_rect_face(const gp_Dir normal,
     return face.Face();
 }
 
-static gp_Dir compute_average_vec(const std::vector<gp_Vec>& vecs)
+/*
+    Constructs the face swept by a disk whose center moves along a horizontal
+        line segment. The face is a stadium: two straight edges parallel to the
+        segment, joined at each end by a half circle centered on the end point
+        of the segment.
+
+    Requires:
+        (1) The start point and the end point have the same Z coordinate.
+        (2) The start point and the end point are distinct.
+
+    Arguments:
+        start:  Start point of the segment.
+        end:    End point of the segment.
+        radius: Radius of the disk.
+*/
+static TopoDS_Face construct_stadium_face(const gp_Pnt& start,
+                                          const gp_Pnt& end,
+                                          const double radius)
 {
-    assert(vecs.size() > 0);
-    
-    gp_Vec res {0, 0, 0};
-    for (const gp_Dir& vec : vecs)
+    assert(compare_fp(start.Z(), end.Z()));
+
+    // Unit vector along the segment and unit vector to its left, both in the
+    //     plane of the face.
+    const gp_Dir along {end.X() - start.X(), end.Y() - start.Y(), 0};
+    const gp_Vec left {gp_Vec(gp::DZ()).Crossed(gp_Vec(along)) * radius};
+    const gp_Vec ahead {gp_Vec(along) * radius};
+
+    const gp_Pnt start_left {start.Translated(left)};
+    const gp_Pnt end_left {end.Translated(left)};
+    const gp_Pnt end_right {end.Translated(-left)};
+    const gp_Pnt start_right {start.Translated(-left)};
+
+    const GC_MakeArcOfCircle end_arc {end_left, end.Translated(ahead), end_right};
+    assert(end_arc.IsDone());
+    const GC_MakeArcOfCircle start_arc {start_right, start.Translated(-ahead), start_left};
+    assert(start_arc.IsDone());
+
+    std::array<BRepBuilderAPI_MakeEdge, 4> face_edges 
+    {
+        BRepBuilderAPI_MakeEdge {start_left, end_left},
+        BRepBuilderAPI_MakeEdge {end_arc.Value()},
+        BRepBuilderAPI_MakeEdge {end_right, start_right},
+        BRepBuilderAPI_MakeEdge {start_arc.Value()}
+    };
+
+    BRepBuilderAPI_MakeWire wire_for_face;
+    for (BRepBuilderAPI_MakeEdge& edge : face_edges)
     {
-        res += vec;
+        assert(edge.IsDone());
+        wire_for_face.Add(edge.Edge());
+        assert(wire_for_face.IsDone());
     }
-    res *= (1. / vecs.size());
 
-    return res;
+    const BRepBuilderAPI_MakeFace face {wire_for_face.Wire(), true};
+    assert(face.IsDone());
+
+    return face.Face();
+}
+
+/*
+    Determines whether sweeping a tool along a curve is a revolution. That is
+        the case when the curve is a circle or an arc of a circle in a
+        horizontal plane, and the circle is wider than the tool.
+
+    Arguments:
+        exact:       The exact geometry of the curve. May be null.
+        tool_radius: Radius of the tool.
+        axis:        Set to the axis of revolution when the sweep is a
+                         revolution.
+        angle:       Set to the angle of revolution, counterclockwise around
+                         axis, when the sweep is a revolution.
+
+    Returns:
+        Whether the sweep is a revolution.
+*/
+static bool circular_sweep(const Handle(Geom_Curve)& exact, 
+                           const double tool_radius,
+                           gp_Ax1& axis,
+                           double& angle)
+{
+    if (exact.IsNull())
+        return false;
+
+    Handle(Geom_Curve) basis {exact};
+    double sweep_angle {2 * M_PI};
+    const Handle(Geom_TrimmedCurve) trimmed {Handle(Geom_TrimmedCurve)::DownCast(exact)};
+    if (!trimmed.IsNull())
+    {
+        basis = trimmed->BasisCurve();
+        sweep_angle = trimmed->LastParameter() - trimmed->FirstParameter();
+    }
+
+    const Handle(Geom_Circle) circle {Handle(Geom_Circle)::DownCast(basis)};
+    if (circle.IsNull())
+        return false;
+
+    // The profile is assumed to be vertical, so the circle must be horizontal.
+    if (!circle->Axis().Direction().IsParallel(gp::DZ(), FP_EQUALS_TOLERANCE))
+        return false;
+
+    // If the profile reaches the axis, the revolution intersects itself.
+    if (circle->Radius() <= tool_radius + FP_EQUALS_TOLERANCE)
+        return false;
+
+    axis = circle->Axis();
+    angle = sweep_angle;
+    return true;
+}
+
+/*
+    Closed segments (i.e. circles) have no start or end point and never get caps.
+*/
+static bool is_closed_segment(const Path& segment)
+{
+    return dynamic_cast<const Circle*>(&segment) != nullptr;
+}
+
+static bool same_point(const Point3D& p1, const Point3D& p2)
+{
+    return compare_fp(p1[0], p2[0]) and compare_fp(p1[1], p2[1]) and compare_fp(p1[2], p2[2]);
 }
 
 /*
@@ -222,37 +353,180 @@ static TopoDS_Shape build_vertical_cylinder(const gp_Pnt& loc,
 
 /*
     See callees for documentation.
+
+    Arguments:
+        compound: The segments that make up the toolpath.
+        profile:  The cross section of the tool.
+        display:  Causes windows to be created showing the results of
+                      toolpath creation.
+        options:  Controls how the toolpath shape is built. The default options
+                      reproduce the reference behavior.
 */
-ToolPath::ToolPath(const std::tuple<std::vector<Line>, 
-                                    std::vector<ArcOfCircle>,
-                                    std::vector<InterpolatedCurve>,
-                                    std::vector<Circle>> compound,
+ToolPath::ToolPath(const SegmentCompound& compound,
                    const CylindricalTool& profile,
-                   const bool display)
+                   const bool display,
+                   const BuildOptions& options)
+    : options(options)
 {
-    for (const Line& l : get<0>(compound))
+    // Every later stage costs time per segment, and B-spline sweeps are the
+    //     slowest of all, so the segments are simplified first. Arcs produced
+    //     by fitting can be merged further, so fitting comes before merging.
+    Instrumentation* const instrumentation {options.instrumentation};
+    const ScopedSpan build_span {instrumentation, "build"};
+
+    const SegmentCompound* source {&compound};
+    SegmentCompound fitted;
+    if (options.arc_fitting_tolerance > 0)
     {
-        const TopoDS_Shape linear {linear_toolpath(l, profile, display)};
-        add_shape(linear);
+        const ScopedSpan span {instrumentation, "fit arcs"};
+        fitted = fit_arcs(*source, options.arc_fitting_tolerance, this->arc_fitting_error);
+        source = &fitted;
     }
-
-    for (const ArcOfCircle& c : get<1>(compound))
+    SegmentCompound coalesced;
+    if (options.coalesce_segments)
     {
-        const TopoDS_Shape curved {curved_toolpath(c, profile, display)};
-        add_shape(curved);
+        const ScopedSpan span {instrumentation, "coalesce"};
+        coalesced = coalesce(*source, options.coalesce_tolerance);
+        source = &coalesced;
     }
 
-    for (const InterpolatedCurve& c : get<2>(compound))
+    // Flatten the compound. Segments are kept in the order of the compound.
+    std::vector<const Path*> segments;
+    segments.reserve(get<0>(*source).size() + get<1>(*source).size() +
+                     get<2>(*source).size() + get<3>(*source).size());
+    for (const Line& l : get<0>(*source))
+        segments.push_back(&l);
+    for (const ArcOfCircle& c : get<1>(*source))
+        segments.push_back(&c);
+    for (const InterpolatedCurve& c : get<2>(*source))
+        segments.push_back(&c);
+    for (const Circle& c : get<3>(*source))
+        segments.push_back(&c);
+
+    build(segments, profile, display);
+}
+
+/*
+    See ToolPath::ToolPath() above. The segments are swept in the order of the
+        list, which is the order of the program when the list comes from
+        G-code or a segment file, so shared caps find every pair of
+        consecutive segments, whatever their kinds.
+
+    Notes:
+        The segments are read in place. Only arc fitting and coalescing make
+            new segments, as they do for compounds.
+
+    Arguments:
+        segments: The segments that make up the toolpath, in order.
+*/
+ToolPath::ToolPath(const SegmentList& segments,
+                   const CylindricalTool& profile,
+                   const bool display,
+                   const BuildOptions& options)
+    : options(options)
+{
+    Instrumentation* const instrumentation {options.instrumentation};
+    const ScopedSpan build_span {instrumentation, "build"};
+
+    const SegmentList* source {&segments};
+    SegmentList fitted;
+    if (options.arc_fitting_tolerance > 0)
     {
-        const TopoDS_Shape curved {curved_toolpath(c, profile, display)};
-        add_shape(curved);
+        const ScopedSpan span {instrumentation, "fit arcs"};
+        fitted = fit_arcs(*source, options.arc_fitting_tolerance, this->arc_fitting_error);
+        source = &fitted;
     }
+    SegmentList coalesced;
+    if (options.coalesce_segments)
+    {
+        const ScopedSpan span {instrumentation, "coalesce"};
+        coalesced = coalesce(*source, options.coalesce_tolerance);
+        source = &coalesced;
+    }
+
+    std::vector<const Path*> paths;
+    paths.reserve(source->size());
+    for (const Segment& segment : *source)
+        paths.push_back(&segment_path(segment));
 
-    for (const Circle& c : get<3>(compound))
+    build(paths, profile, display);
+}
+
+/*
+    Sweeps the profile along every segment and unites the results. Shared by
+        the constructors, once the segments are final.
+
+    Arguments:
+        segments: The segments, in the order used for shared caps and for
+                      sequential unions.
+        profile:  The cross section of the tool.
+        display:  See ToolPath::ToolPath().
+
+    Returns:
+        None.
+*/
+void ToolPath::build(const std::vector<const Path*>& segments,
+                     const CylindricalTool& profile,
+                     const bool display)
+{
+    Instrumentation* const instrumentation {this->options.instrumentation};
+    const BuildOptions& options {this->options};
+    if (instrumentation)
+        instrumentation->add_to_counter("segments", segments.size());
+
+    // The per-segment solids don't depend on each other, so they are built
+    //     concurrently. Windows can't be opened from worker threads, so
+    //     displaying forces a single worker.
+    const unsigned int threads {display ? 1 : options.threads};
+
+    const std::vector<bool> start_caps {segment_start_caps(segments)};
+
+    // The operands of the union. For the general fuse these are the individual
+    //     sweeps and caps, otherwise they are the per-segment solids.
+    std::vector<TopoDS_Shape> operands;
+    if (options.union_mode == UnionMode::general_fuse)
     {
-        const TopoDS_Shape curved {curved_toolpath(c, profile, display, false)};
-        add_shape(curved);
+        // Collect every sweep and every cap without fusing anything.
+        std::vector<std::vector<TopoDS_Shape>> segment_pieces(segments.size());
+        parallel_for(segments.size(), threads, 
+                     [&](const std::size_t i)
+                     {
+                         const ScopedSpan span {instrumentation, "segment", static_cast<int64_t>(i)};
+                         segment_pieces[i] = segment_parts(*segments[i], profile, display, start_caps[i]);
+                     });
+
+        for (const std::vector<TopoDS_Shape>& pieces : segment_pieces)
+            operands.insert(operands.end(), pieces.begin(), pieces.end());
     }
+    else
+    {
+        operands.resize(segments.size());
+        parallel_for(segments.size(), threads, 
+                     [&](const std::size_t i)
+                     {
+                         const ScopedSpan span {instrumentation, "segment", static_cast<int64_t>(i)};
+                         operands[i] = segment_toolpath(*segments[i], profile, display, start_caps[i]);
+                     });
+    }
+
+    if (instrumentation)
+        instrumentation->add_to_counter("operands", operands.size());
+
+    // Only the union is ordered.
+    const auto unite = [&options, instrumentation](const std::vector<TopoDS_Shape>& shapes,
+                                                   const unsigned int workers)
+    {
+        return fuse_with_mode(options, shapes, workers, instrumentation);
+    };
+
+    const ScopedSpan union_span {instrumentation, "union"};
+    if (options.cluster_disjoint)
+        this->toolpath_shape_union = fuse_clusters(operands, options.use_obb, options.threads, unite, instrumentation);
+    else if (options.union_mode == UnionMode::sequential)
+        for (const TopoDS_Shape& s : operands)
+            add_shape(s);
+    else
+        this->toolpath_shape_union = unite(operands, options.threads);
 
     if (display)
     {
@@ -262,6 +536,33 @@ ToolPath::ToolPath(const std::tuple<std::vector<Line>,
     }
 }
 
+/*
+    Which segments need a start cap. Consecutive segments usually share an end
+        point. The end cap of the first segment covers the start of the second,
+        so with BuildOptions::shared_caps the second doesn't need a start cap.
+
+    Arguments:
+        segments: The segments, in the order in which they are swept.
+
+    Returns:
+        One flag per segment.
+*/
+std::vector<bool> ToolPath::segment_start_caps(const std::vector<const Path*>& segments) const
+{
+    std::vector<bool> start_caps(segments.size(), true);
+    if (!this->options.shared_caps)
+        return start_caps;
+
+    for (std::size_t i {1}; i < segments.size(); ++i)
+    {
+        if (is_closed_segment(*segments[i - 1]) or is_closed_segment(*segments[i]))
+            continue;
+        if (same_point(segment_endpoints(*segments[i - 1]).second, segment_endpoints(*segments[i]).first))
+            start_caps[i] = false;
+    }
+    return start_caps;
+}
+
 /*
     Generates a surface mesh on the toolpath topology.
     
@@ -278,15 +579,22 @@ ToolPath::ToolPath(const std::tuple<std::vector<Line>,
     Arguments:
         angle:      Maximum angular deflection allowed when generating surface mesh. 
         deflection: Maximum linear deflection allowed when generating surface mesh.
+        vertex_normals: Compute a normal at every mesh vertex. Only needed when
+                            exporting with FacetNormals::vertex_average, and 
+                            costly on large meshes.
     
     Return:
         None.
 */
 void ToolPath::mesh_surface(const double angle, 
-                            const double deflection)
+                            const double deflection,
+                            const bool vertex_normals)
 {
+    const ScopedSpan span {this->options.instrumentation, "mesh"};
+
     // Get rid of any previous mesh associated with this toolpath.
     BRepTools::Clean(this->toolpath_shape_union, true);
+    this->mesh_buffers = std::make_shared<MeshBuffers>();
 
     IMeshTools_Parameters mesh_params;
     mesh_params.Angle = angle;
@@ -305,73 +613,13 @@ void ToolPath::mesh_surface(const double angle,
         const Handle(Poly_Triangulation) poly_tri {BRep_Tool::Triangulation(face, loc)};
 
         if (!poly_tri.IsNull())
-            BRepLib_ToolTriangulatedShape::ComputeNormals(face, poly_tri);
-    }
-}
-
-/*
-    Writes the meshed toolpath to a file. Even if the file already exists, it is 
-        completely overwritten. Per-face normals are included in the .stl file.
-        Each per-face normal is computed by averaging whatever vertex normals
-        are associated with the vertices of the face.
-    See https://www.fabbers.com/tech/STL_Format for the closest thing to a
-        standardization of the STL format.
-
-    Assumes:
-        (1) The caller is OK with the file being overwritten if it already exists.
-        (2) The toolpath has already been meshed in a satisfactory way.
-        
-    Arguments:
-        solid_name: The desired name of the solid in the .stl file.
-        file_path:  Absolute path to the file to write to. 
-    
-    Returns:
-        None.
-*/
-void ToolPath::shape_to_stl(const std::string solid_name, 
-                            const std::string filepath) const
-{
-    std::ofstream f {filepath};  
-
-    // Ensure that ample precision is used when writing to the .stl. 
-    f.precision(FP_WRITE_PRECISION);
-    assert(f.good());
-
-    f << "solid " << solid_name << std::endl;
-
-    for (TopExp_Explorer face_it {this->toolpath_shape_union, TopAbs_FACE}; face_it.More(); face_it.Next())
-    {
-        const TopoDS_Face face {TopoDS::Face(face_it.Current())};
-        TopLoc_Location loc;
-        const Handle(Poly_Triangulation) poly_tri {BRep_Tool::Triangulation(face, loc)};
-        
-        // It's not this function's resposibility to deal with faces that are
-        //     not triangulated.
-        if (!poly_tri.IsNull())
-            for (int tri_it {1}; tri_it <= poly_tri->NbTriangles(); ++tri_it)
-            {
-                const Poly_Triangle& tri {poly_tri->Triangle(tri_it)};
-                
-                // Average the vertex normals to compute the face normal. 
-                int v1_idx, v2_idx, v3_idx;
-                tri.Get(v1_idx, v2_idx, v3_idx);
-                const gp_Vec face_normal {compute_average_vec({poly_tri->Normal(v1_idx), poly_tri->Normal(v2_idx), poly_tri->Normal(v3_idx)})};
-
-                // Write the face normals.
-                f << FOUR_SPACES << "facet normal " << face_normal.X() << " " <<  face_normal.Y() << " " << face_normal.Z() << std::endl;
-                
-                // Write the vertices.
-                f << EIGHT_SPACES << "outer loop" << std::endl;
-                for (int i {1}; i <= VERTICES_PER_TRIANGLE; ++i)
-                {
-                    f << TWELVE_SPACES << "vertex " << (poly_tri->Node(tri(i))).X() << " " << (poly_tri->Node(tri(i))).Y() << " " << (poly_tri->Node(tri(i))).Z() << std::endl;
-                }
-                f << EIGHT_SPACES << "endloop" << std::endl;
-                f << FOUR_SPACES << "endfacet" << std::endl;
-            }
+        {
+            if (vertex_normals)
+                BRepLib_ToolTriangulatedShape::ComputeNormals(face, poly_tri);
+            if (this->options.instrumentation)
+                this->options.instrumentation->add_to_counter("triangles", poly_tri->NbTriangles());
+        }
     }
-
-    f << "endsolid " << solid_name;
 }
 
 /*
@@ -389,14 +637,16 @@ void ToolPath::add_shape(const TopoDS_Shape& s)
         this->toolpath_shape_union = s;
     else
     {
-        BRepAlgoAPI_Fuse toolpath_union {this->toolpath_shape_union, s};
-        assert(!toolpath_union.HasErrors());
-        this->toolpath_shape_union = toolpath_union.Shape();
+        this->toolpath_shape_union = fuse_pair(this->toolpath_shape_union, s, "union fuse", "union booleans",
+                                               this->options.instrumentation);
+        if (this->options.instrumentation)
+            this->options.instrumentation->sample_counter("union faces", count_faces(this->toolpath_shape_union));
     }
 }
 
 /*
-    Sweeps a profile along a curve and adds caps, forming a curved toolpath.
+    Sweeps a profile along a curve and builds caps, forming the pieces of a curved
+        toolpath. The pieces are not fused together.
 
     Notes:
         The angle between the tool profile and the curve is maintained along
@@ -439,15 +689,20 @@ void ToolPath::add_shape(const TopoDS_Shape& s)
         add_caps: Adds caps at the start point of the curve and the end point
                       of the curve. Unnecessary when the curve is closed (e.g.
                       a circle).
+        add_start_cap: When caps are added, whether the start cap is built. The
+                           start cap can be left out when another solid already
+                           covers the start point.
     
     Return:
-        The shape resulting from extruding the profile along the curve. May not
-            be closed, as a result of self intersection.
+        The shape resulting from extruding the profile along the curve, followed
+            by the start and end caps if they were requested. The extruded shape
+            may not be closed, as a result of self intersection.
 */
-TopoDS_Shape ToolPath::curved_toolpath(const Curve& curve,
-                                       const CylindricalTool& profile,
-                                       const bool display,
-                                       const bool add_caps) const
+std::vector<TopoDS_Shape> ToolPath::curved_toolpath_parts(const Curve& curve,
+                                                          const CylindricalTool& profile,
+                                                          const bool display,
+                                                          const bool add_caps,
+                                                          const bool add_start_cap) const
 {
     const Handle(Geom_BSplineCurve) bspline {curve.representation};
     assert(((*bspline).IsClosed() and !add_caps) or (!(*bspline).IsClosed() and add_caps));
@@ -481,26 +736,63 @@ TopoDS_Shape ToolPath::curved_toolpath(const Curve& curve,
         view.show_shapes(shapes); 
     }
 
-    // Do the sweep.
-    const BRepOffsetAPI_MakePipe pipe_topology_builder {curve_wire_topology, profile_topology};
-    TopoDS_Shape pipe_topology {pipe_topology_builder.Pipe().Shape()}; 
-    // This assertion fails even when the shape looks like it is closed...
-    //     I have no idea why...
-    // assert(pipe_topology.Closed());
+    // Do the sweep. Along a horizontal arc or circle, the sweep is a revolution
+    //     of the profile around the axis of the circle. Revolving gives planes
+    //     and cylinders, which are far cheaper to fuse and to mesh than the
+    //     B-spline faces produced by piping along the B-spline representation.
+    TopoDS_Shape pipe_topology;
+    gp_Ax1 revolution_axis;
+    double revolution_angle;
+    {
+        const ScopedSpan span {this->options.instrumentation, "sweep"};
+        if (this->options.analytic_arcs and 
+            circular_sweep(curve.exact_representation, profile.radius, revolution_axis, revolution_angle))
+        {
+            BRepPrimAPI_MakeRevol revol_topology_builder {profile_topology, revolution_axis, revolution_angle};
+            assert(revol_topology_builder.IsDone());
+            pipe_topology = revol_topology_builder.Shape();
+        }
+        else
+        {
+            const BRepOffsetAPI_MakePipe pipe_topology_builder {curve_wire_topology, profile_topology};
+            pipe_topology = pipe_topology_builder.Pipe().Shape(); 
+            // This assertion fails even when the shape looks like it is closed...
+            //     I have no idea why...
+            // assert(pipe_topology.Closed());
+        }
+    }
     
+    std::vector<TopoDS_Shape> parts {pipe_topology};
     if (add_caps)
     {
         // Build the cylinders that act as the start and end caps of the tool path. 
         // Assumes that caps should have axis of rotation in +Z direction.
-        TopoDS_Shape start_cap {build_vertical_cylinder(start, profile.radius, profile.height)};
-        TopoDS_Shape end_cap {build_vertical_cylinder(end, profile.radius, profile.height)};
-
-        BRepAlgoAPI_Fuse pipe_topology_with_start_cap {pipe_topology, start_cap};
-        assert(!pipe_topology_with_start_cap.HasErrors());
-        BRepAlgoAPI_Fuse pipe_topology_with_both_caps {pipe_topology_with_start_cap.Shape(), end_cap};
-        assert(!pipe_topology_with_both_caps.HasErrors());
-        pipe_topology = pipe_topology_with_both_caps;
+        if (add_start_cap)
+            parts.push_back(build_vertical_cylinder(start, profile.radius, profile.height));
+        parts.push_back(build_vertical_cylinder(end, profile.radius, profile.height));
     }
+    
+    return parts;
+}
+
+/*
+    Sweeps a profile along a curve and adds caps, forming a curved toolpath.
+        See curved_toolpath_parts() for the requirements on the arguments.
+
+    Return:
+        The union of the pieces produced by curved_toolpath_parts().
+*/
+TopoDS_Shape ToolPath::curved_toolpath(const Curve& curve,
+                                       const CylindricalTool& profile,
+                                       const bool display,
+                                       const bool add_caps,
+                                       const bool add_start_cap) const
+{
+    const std::vector<TopoDS_Shape> parts {curved_toolpath_parts(curve, profile, display, add_caps, add_start_cap)};
+    
+    TopoDS_Shape pipe_topology {parts.front()};
+    for (auto it {parts.begin() + 1}; it != parts.end(); ++it)
+        pipe_topology = fuse_pair(pipe_topology, *it, "cap fuse", "cap booleans", this->options.instrumentation);
 
     if (display)
     {
@@ -513,7 +805,8 @@ TopoDS_Shape ToolPath::curved_toolpath(const Curve& curve,
 }
 
 /*
-    Sweeps a profile along a line and adds caps, forming a linear toolpath.
+    Sweeps a profile along a line and builds caps, forming the pieces of a linear
+        toolpath. The pieces are not fused together.
     
     Assumes:
         (1) The rotational axis of symmetry of the tool profile points in the +Z
@@ -527,17 +820,47 @@ TopoDS_Shape ToolPath::curved_toolpath(const Curve& curve,
         profile: The cross section of the tool.
         display: Causes windows to be created showing the results of
                      toolpath creation. 
+        add_start_cap: Whether the start cap is built. The start cap can be left
+                           out when another solid already covers the start
+                           point.
 
     Return:
-        The shape resulting from extruding the profile along the line.
+        The shape resulting from extruding the profile along the line, followed
+            by the start cap (if requested) and the end cap. When the analytic
+            fast path applies to the line, a single closed solid that already
+            includes both caps.
 */
-TopoDS_Shape ToolPath::linear_toolpath(const Line& line,
-                                       const CylindricalTool& profile,
-                                       const bool display) const
+std::vector<TopoDS_Shape> ToolPath::linear_toolpath_parts(const Line& line,
+                                                          const CylindricalTool& profile,
+                                                          const bool display,
+                                                          const bool add_start_cap) const
 {
     const gp_Vec path {line.line[0], line.line[1], line.line[2]}; 
     const gp_Pnt start {line.start_point[0], line.start_point[1], line.start_point[2]};
     const gp_Pnt end {start.Translated(path)};
+
+    // A horizontal move sweeps a stadium, which is exactly the union of the
+    //     prism and both caps. Extruding the stadium directly gives a closed
+    //     solid without any Boolean operation.
+    const bool horizontal {compare_fp(path.Z(), 0) and 
+                           !(compare_fp(path.X(), 0) and compare_fp(path.Y(), 0))};
+    if (this->options.analytic_lines and horizontal)
+    {
+        const TopoDS_Face stadium_topology {construct_stadium_face(start, end, profile.radius)};
+
+        if (display)
+        {
+            const std::vector<TopoDS_Shape> shapes {stadium_topology};
+            GlfwOcctView view;
+            view.show_shapes(shapes); 
+        }
+
+        const ScopedSpan span {this->options.instrumentation, "sweep"};
+        BRepPrimAPI_MakePrism stadium_prism_builder {stadium_topology, gp_Vec(0, 0, profile.height)};
+        assert(stadium_prism_builder.IsDone());
+        return {stadium_prism_builder.Shape()};
+    }
+
     const TopoDS_Face profile_topology {construct_rect_face(path, start, profile.radius * 2, profile.height)};
 
     if (display)
@@ -552,26 +875,144 @@ TopoDS_Shape ToolPath::linear_toolpath(const Line& line,
     }
     
     // Do the sweep.
-    BRepPrimAPI_MakePrism prism_topology_builder {profile_topology, path};
-    assert(prism_topology_builder.IsDone());
-    const TopoDS_Shape& prism_topology {prism_topology_builder.Shape()};
+    TopoDS_Shape prism_topology;
+    {
+        const ScopedSpan span {this->options.instrumentation, "sweep"};
+        BRepPrimAPI_MakePrism prism_topology_builder {profile_topology, path};
+        assert(prism_topology_builder.IsDone());
+        prism_topology = prism_topology_builder.Shape();
+    }
 
     // Build the cylinders that act as the start and end caps of the tool path. 
     // Assumes that caps should have axis of rotation in +Z direction.
-    TopoDS_Shape start_cap {build_vertical_cylinder(start, profile.radius, profile.height)};
-    TopoDS_Shape end_cap {build_vertical_cylinder(end, profile.radius, profile.height)};
+    std::vector<TopoDS_Shape> parts {prism_topology};
+    if (add_start_cap)
+        parts.push_back(build_vertical_cylinder(start, profile.radius, profile.height));
+    parts.push_back(build_vertical_cylinder(end, profile.radius, profile.height));
+
+    return parts;
+}
+
+/*
+    Sweeps a profile along a line and adds caps, forming a linear toolpath.
+        See linear_toolpath_parts() for the requirements on the arguments.
 
-    BRepAlgoAPI_Fuse prism_topology_with_start_cap {prism_topology, start_cap};
-    assert(!prism_topology_with_start_cap.HasErrors());
-    BRepAlgoAPI_Fuse prism_topology_with_both_caps {prism_topology_with_start_cap.Shape(), end_cap};
-    assert(!prism_topology_with_both_caps.HasErrors());
+    Return:
+        The union of the pieces produced by linear_toolpath_parts().
+*/
+TopoDS_Shape ToolPath::linear_toolpath(const Line& line,
+                                       const CylindricalTool& profile,
+                                       const bool display,
+                                       const bool add_start_cap) const
+{
+    const std::vector<TopoDS_Shape> parts {linear_toolpath_parts(line, profile, display, add_start_cap)};
+
+    TopoDS_Shape prism_topology {parts.front()};
+    for (auto it {parts.begin() + 1}; it != parts.end(); ++it)
+        prism_topology = fuse_pair(prism_topology, *it, "cap fuse", "cap booleans", this->options.instrumentation);
 
     if (display)
     {
-        const std::vector<TopoDS_Shape> shapes {prism_topology_with_both_caps};
+        const std::vector<TopoDS_Shape> shapes {prism_topology};
         GlfwOcctView view;
         view.show_shapes(shapes); 
     }
     
-    return prism_topology_with_both_caps;
+    return prism_topology;
+}
+
+/*
+    Builds the pieces of the toolpath of a single segment of any kind. Circles
+        are closed, so they don't get caps.
+    See linear_toolpath_parts() and curved_toolpath_parts() for documentation.
+*/
+std::vector<TopoDS_Shape> ToolPath::segment_parts(const Path& segment,
+                                                  const CylindricalTool& profile,
+                                                  const bool display,
+                                                  const bool add_start_cap) const
+{
+    if (const Line* line {dynamic_cast<const Line*>(&segment)})
+        return linear_toolpath_parts(*line, profile, display, add_start_cap);
+
+    const Curve* curve {dynamic_cast<const Curve*>(&segment)};
+    assert(curve != nullptr);
+    return curved_toolpath_parts(*curve, profile, display, !is_closed_segment(segment), add_start_cap);
+}
+
+/*
+    Builds the toolpath of a single segment of any kind. Circles are closed, so
+        they don't get caps.
+    See linear_toolpath() and curved_toolpath() for documentation.
+*/
+TopoDS_Shape ToolPath::segment_toolpath(const Path& segment,
+                                        const CylindricalTool& profile,
+                                        const bool display,
+                                        const bool add_start_cap) const
+{
+    if (const Line* line {dynamic_cast<const Line*>(&segment)})
+        return linear_toolpath(*line, profile, display, add_start_cap);
+
+    const Curve* curve {dynamic_cast<const Curve*>(&segment)};
+    assert(curve != nullptr);
+    return curved_toolpath(*curve, profile, display, !is_closed_segment(segment), add_start_cap);
+}
+
+/*
+    Computes the points at which the tool enters and leaves a segment. For a
+        closed segment both points are the same.
+
+    Arguments:
+        segment: A line or a curve.
+
+    Returns:
+        The start point and the end point of the segment.
+*/
+std::pair<Point3D, Point3D> ToolPath::segment_endpoints(const Path& segment) const
+{
+    if (const Line* line {dynamic_cast<const Line*>(&segment)})
+    {
+        const Point3D& start {line->start_point};
+        const Point3D end {start[0] + line->line[0], start[1] + line->line[1], start[2] + line->line[2]};
+        return {start, end};
+    }
+
+    const Curve* curve {dynamic_cast<const Curve*>(&segment)};
+    assert(curve != nullptr);
+    const gp_Pnt start {curve->representation->StartPoint()};
+    const gp_Pnt end {curve->representation->EndPoint()};
+    return {{start.X(), start.Y(), start.Z()}, {end.X(), end.Y(), end.Z()}};
+}
+
+/*
+    A box that holds the path of a segment, as its lowest and its highest
+        corner. Curves lie within the box of their poles, so the box of a
+        curve may be larger than the curve, but never smaller.
+*/
+std::pair<Point3D, Point3D> ToolPath::segment_bounds(const Path& segment)
+{
+    if (const Line* line {dynamic_cast<const Line*>(&segment)})
+    {
+        const Point3D& start {line->start_point};
+        const Point3D end {start[0] + line->line[0], start[1] + line->line[1], start[2] + line->line[2]};
+        return {{std::min(start[0], end[0]), std::min(start[1], end[1]), std::min(start[2], end[2])},
+                {std::max(start[0], end[0]), std::max(start[1], end[1]), std::max(start[2], end[2])}};
+    }
+
+    const Curve* curve {dynamic_cast<const Curve*>(&segment)};
+    assert(curve != nullptr);
+    const Handle(Geom_BSplineCurve)& bspline {curve->representation};
+    const gp_Pnt& first {bspline->Pole(1)};
+    Point3D low {first.X(), first.Y(), first.Z()};
+    Point3D high {low};
+    for (int i {2}; i <= bspline->NbPoles(); ++i)
+    {
+        const gp_Pnt& pole {bspline->Pole(i)};
+        const Point3D p {pole.X(), pole.Y(), pole.Z()};
+        for (int k {0}; k < 3; ++k)
+        {
+            low[k] = std::min(low[k], p[k]);
+            high[k] = std::max(high[k], p[k]);
+        }
+    }
+    return {low, high};
 }
@@ -0,0 +1,146 @@
+// Standard library.
+#include <vector>
+#include <span>
+#include <cmath>
+#include <cassert>
+#include <functional>
+#include <utility>
+
+// Third party.
+
+// OCCT.
+#include "gp_Pnt.hxx"
+#include "BRep_Tool.hxx"
+#include "TopoDS.hxx"
+#include "TopoDS_Face.hxx"
+#include "TopExp_Explorer.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library public.
+#include "toolpath.hxx"
+#include "triangle_range.hxx"
+
+// Library private.
+#include "util_p.hxx"
+
+TriangleRange::TriangleRange(const TopoDS_Shape& shape)
+    : shape(shape)
+{
+}
+
+/*
+    Starts the walk and returns an iterator at the first triangle.
+*/
+TriangleRange::Iterator TriangleRange::begin()
+{
+    assert(!this->face_it);
+
+    this->face_it = std::make_unique<TopExp_Explorer>(this->shape, TopAbs_FACE);
+    advance();
+    return Iterator {this};
+}
+
+/*
+    Moves to the next triangle, moving on to the next triangulated face when
+        the current one is exhausted. Sets done after the last triangle.
+*/
+void TriangleRange::advance()
+{
+    // Find a face with a triangle left.
+    while (this->poly_tri.IsNull() or this->next_triangle > this->poly_tri->NbTriangles())
+    {
+        if (!this->poly_tri.IsNull())
+        {
+            this->face_it->Next();
+            ++this->face_id;
+        }
+
+        if (!this->face_it->More())
+        {
+            this->done = true;
+            return;
+        }
+
+        const TopoDS_Face face {TopoDS::Face(this->face_it->Current())};
+        TopLoc_Location loc;
+        this->poly_tri = BRep_Tool::Triangulation(face, loc);
+        this->reversed = face.Orientation() == TopAbs_REVERSED;
+        this->next_triangle = 1;
+
+        // Faces that are not triangulated are passed over, but keep their id.
+        if (this->poly_tri.IsNull())
+        {
+            this->face_it->Next();
+            ++this->face_id;
+        }
+    }
+
+    int v_idx[VERTICES_PER_TRIANGLE];
+    this->poly_tri->Triangle(this->next_triangle).Get(v_idx[0], v_idx[1], v_idx[2]);
+    if (this->reversed)
+        std::swap(v_idx[1], v_idx[2]);
+    ++this->next_triangle;
+
+    for (int k {0}; k < VERTICES_PER_TRIANGLE; ++k)
+    {
+        const gp_Pnt vertex {this->poly_tri->Node(v_idx[k])};
+        this->current.vertices[k] = {vertex.X(), vertex.Y(), vertex.Z()};
+    }
+
+    const Point3D& p0 {this->current.vertices[0]};
+    const Point3D& p1 {this->current.vertices[1]};
+    const Point3D& p2 {this->current.vertices[2]};
+    const Vec3D u {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const Vec3D v {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    const Vec3D cross {u[1] * v[2] - u[2] * v[1],
+                       u[2] * v[0] - u[0] * v[2],
+                       u[0] * v[1] - u[1] * v[0]};
+    const double length {std::sqrt(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2])};
+    this->current.normal = length > 0 ? Vec3D {cross[0] / length, cross[1] / length, cross[2] / length}
+                                      : Vec3D {0, 0, 0};
+    this->current.face_id = this->face_id;
+}
+
+/*
+    Returns the triangles of the meshed toolpath as a lazy, single pass range.
+        Triangles are produced one at a time while the range is iterated.
+
+    Assumes:
+        (1) The toolpath has already been meshed in a satisfactory way.
+*/
+TriangleRange ToolPath::triangles() const
+{
+    return TriangleRange {this->toolpath_shape_union};
+}
+
+/*
+    Hands the triangles of the meshed toolpath to a consumer in fixed size
+        batches. Only one batch is held in memory at a time.
+
+    Arguments:
+        batch_size: Number of triangles per batch. The last batch may be
+                        smaller. Must be positive.
+        consume:    Called with every batch, in order.
+
+    Returns:
+        None.
+*/
+void ToolPath::for_each_triangle_batch(const std::size_t batch_size,
+                                       const std::function<void(std::span<const Triangle>)>& consume) const
+{
+    assert(batch_size > 0);
+
+    std::vector<Triangle> batch;
+    batch.reserve(batch_size);
+    for (const Triangle& triangle : triangles())
+    {
+        batch.push_back(triangle);
+        if (batch.size() == batch_size)
+        {
+            consume(batch);
+            batch.clear();
+        }
+    }
+    if (!batch.empty())
+        consume(batch);
+}
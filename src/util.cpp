@@ -8,7 +8,7 @@
 */
 bool compare_fp(double fp1, double fp2, double eps)
 {
-    if (abs(fp1 - fp2) < eps)
+    if (std::abs(fp1 - fp2) < eps)
         return true;
     return false;
 }
@@ -1,14 +1,28 @@
 // Standard library.
 #include <fstream>
+#include <iterator>
 #include <vector>
 #include <string>
 #include <filesystem>
 #include <cmath>
 #include <tuple>
+#include <map>
+#include <utility>
+#include <cstdint>
+#include <cassert>
 
 // Third party.
 #include "geometric_primitives.hxx"
 #include "toolpath.hxx"
+#include "instrumentation.hxx"
+#include "gcode.hxx"
+#include "segment_file.hxx"
+#include "segment_list.hxx"
+#include "tiled_toolpath.hxx"
+#include "Poly_Triangulation.hxx"
+
+// Library private.
+#include "mesh_export_p.hxx"
 
 using namespace std;
 
@@ -35,6 +49,20 @@ struct CylCompoundToolpathTest
     const std::pair<double, double> meshing_parameters;
     const bool visualize;
     const filesystem::path results_directory;
+    const BuildOptions options {};
+    const StlFormat stl_format {StlFormat::ascii};
+    const FacetNormals facet_normals {FacetNormals::vertex_average};
+    // Also write the welded mesh as .ply, .obj and .glb.
+    const bool indexed_export {false};
+    // When not empty, the toolpath is read from this program instead of path.
+    const string gcode {};
+    // Record the build and the exports, then write a trace and print a
+    //     summary. Otherwise BuildOptions::instrumentation stays null.
+    const bool instrumented {false};
+    // When positive, the toolpath is also built and written on one worker and
+    //     on this many, and the .stl files of both runs must be identical, in
+    //     binary and in text.
+    const unsigned int compared_threads {0};
 };
 
 const vector<CylCompoundToolpathTest> tests 
@@ -1140,7 +1168,528 @@ const vector<CylCompoundToolpathTest> tests
   // //   default_mesh_options,
   // //   default_visualize,
   // //   default_results_directory
-  // // }
+  // // },
+
+  // Test Class: Build Options.
+  {
+    "[build options]: tree reduction, four lines a square",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {1, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        },
+        {
+          {1, 1, 0},
+          {-1, 0, 0}
+        },
+        {
+          {0, 1, 0},
+          {0, -1, 0}
+        }
+      },
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {UnionMode::tree_reduction}
+  },
+  {
+    "[build options]: general fuse, realistic touching",
+    {
+      // Lines.
+      {
+        {
+          {6.044, -.888, -.3},
+          {-.014, .553, 0}
+        }
+      },
+      // Arcs of circles.
+      {
+        {
+          {{6.030, -.335, -.3}, {3.669, -.381, -.3}}, 
+          {4, -sqrt(pow(249.72, 2) - pow((4 + .014885), 2)) + 249.31, -.3}, 
+        }
+      },
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {UnionMode::general_fuse}
+  },
+  {
+    "[build options]: clustered, circles not touching",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {1, 0, 0},
+          {0, 1, 0},
+          {-1, 0, 0}
+        },
+        {
+          {5 + 1, 5, 0},
+          {5, 5 + 1, 0},
+          {5 - 1, 5, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.union_mode = UnionMode::tree_reduction, .cluster_disjoint = true}
+  },
+  {
+    "[build options]: shared caps, four lines a square",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {1, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        },
+        {
+          {1, 1, 0},
+          {-1, 0, 0}
+        },
+        {
+          {0, 1, 0},
+          {0, -1, 0}
+        }
+      },
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.shared_caps = true}
+  },
+  {
+    "[build options]: analytic lines, realistic touching",
+    {
+      // Lines.
+      {
+        {
+          {6.044, -.888, -.3},
+          {-.014, .553, 0}
+        }
+      },
+      // Arcs of circles.
+      {
+        {
+          {{6.030, -.335, -.3}, {3.669, -.381, -.3}}, 
+          {4, -sqrt(pow(249.72, 2) - pow((4 + .014885), 2)) + 249.31, -.3}, 
+        }
+      },
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.analytic_lines = true}
+  },
+  {
+    "[build options]: analytic arcs, arc and circle",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {
+        {
+          {{1, 0, 0}, {0, 1, 0}}, 
+          {.5, sqrt(1 - pow(.5, 2)), 0}, 
+        }  
+      },
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {5 + 1, 5, 0},
+          {5, 5 + 1, 0},
+          {5 - 1, 5, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.analytic_arcs = true}
+  },
+  {
+    "[build options]: coalesced collinear lines and split arc",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {.25, 0, 0}
+        },
+        {
+          {.25, 0, 0},
+          {.25, 0, 0}
+        },
+        {
+          {.5, 0, 0},
+          {.5, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        }
+      },
+      // Arcs of circles.
+      {
+        {
+          {{3, 0, 0}, {2 + 1/pow(2, .5), 1/pow(2, .5), 0}}, 
+          {2 + cos(M_PI / 8), sin(M_PI / 8), 0}
+        },
+        {
+          {{2 + 1/pow(2, .5), 1/pow(2, .5), 0}, {2, 1, 0}}, 
+          {2 + cos(3 * M_PI / 8), sin(3 * M_PI / 8), 0}
+        }
+      },
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.coalesce_segments = true}
+  },
+  {
+    "[build options]: arc fitting, planar horseshoe",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {
+        {
+          {{-1, 1, 0}, {-1, .4, 0}, {0, 0, 0}, {1, .4, 0}, {1, 1, 0}}, 
+          {{0, {0, -1, 0}}, {1, {0, -1, 0}}, {2, {1, 0, 0}}, {3, {0, 1, 0}}, {4, {0, 1, 0}}}
+        }
+      },
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.analytic_lines = true, .analytic_arcs = true, .arc_fitting_tolerance = .001}
+  },
+  {
+    "[build options]: one worker and four, lines an arc and a circle",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {1, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        },
+        {
+          {0, 1, 0},
+          {0, -1, 0}
+        }
+      },
+      // Arcs of circles.
+      {
+        {
+          {{1, 1, 0}, {0, 1, 0}},
+          {.5, 1.5, 0}
+        }
+      },
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {3 + 1, 0, 0},
+          {3, 1, 0},
+          {3 - 1, 0, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.union_mode = UnionMode::tree_reduction},
+    StlFormat::binary,
+    FacetNormals::vertex_average,
+    false,
+    {},
+    false,
+    4
+  },
+
+  // Test Class: Export.
+  {
+    "[export]: memory mapped binary stl, arc and circle",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {
+        {
+          {{1, 0, 0}, {0, 1, 0}}, 
+          {.5, sqrt(1 - pow(.5, 2)), 0}, 
+        }  
+      },
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {5 + 1, 5, 0},
+          {5, 5 + 1, 0},
+          {5 - 1, 5, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.mapped_output = true},
+    StlFormat::binary
+  },
+  {
+    "[export]: geometric normals and indexed meshes, four lines a square",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {1, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        },
+        {
+          {1, 1, 0},
+          {-1, 0, 0}
+        },
+        {
+          {0, 1, 0},
+          {0, -1, 0}
+        }
+      },
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {},
+    StlFormat::ascii,
+    FacetNormals::geometric,
+    true
+  },
+  {
+    "[export]: gzip compressed meshes, arc and circle",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {
+        {
+          {{1, 0, 0}, {0, 1, 0}}, 
+          {.5, sqrt(1 - pow(.5, 2)), 0}, 
+        }  
+      },
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {5 + 1, 5, 0},
+          {5, 5 + 1, 0},
+          {5 - 1, 5, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.output_compression = Compression::gzip},
+    StlFormat::ascii,
+    FacetNormals::vertex_average,
+    true
+  },
+  {
+    // The circle alone meshes to several blocks of faces, so the text is
+    //     formatted by several workers at once.
+    "[export]: ascii stl on one worker and four, arc and circle",
+    {
+      // Lines.
+      {},
+      // Arcs of circles.
+      {
+        {
+          {{1, 0, 0}, {0, 1, 0}}, 
+          {.5, sqrt(1 - pow(.5, 2)), 0}, 
+        }  
+      },
+      // Interpolated curves.
+      {},
+      // Circles.
+      {
+        {
+          {5 + 1, 5, 0},
+          {5, 5 + 1, 0},
+          {5 - 1, 5, 0}
+        }
+      }
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {},
+    StlFormat::ascii,
+    FacetNormals::vertex_average,
+    false,
+    {},
+    false,
+    4
+  },
+  // Test Class: G-code.
+  {
+    "[gcode]: lines, arcs and a circle",
+    {},
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {},
+    StlFormat::ascii,
+    FacetNormals::vertex_average,
+    false,
+    "%\n"
+    "(Modal lines, incremental moves, and arcs given by center and by radius.)\n"
+    "N10 G21 G90 G17 G0 X0 Y0 Z0\n"
+    "N20 G1 X1 F600\n"
+    "N30 G91 Y1\n"
+    "N40 G90 G2 X2 Y2 I1 J0\n"
+    "N50 G3 X3 Y3 R1 ; quarter turn\n"
+    "N60 G2 I0 J-1\n"
+    "%\n"
+  },
+  // Test Class: Instrumentation.
+  {
+    "[instrumentation]: tree reduction with clusters, four lines a square",
+    {
+      // Lines.
+      {
+        {
+          {0, 0, 0},
+          {1, 0, 0}
+        },
+        {
+          {1, 0, 0},
+          {0, 1, 0}
+        },
+        {
+          {1, 1, 0},
+          {-1, 0, 0}
+        },
+        {
+          {0, 1, 0},
+          {0, -1, 0}
+        }
+      },
+      // Arcs of circles.
+      {},
+      // Interpolated curves.
+      {},
+      // Circles
+      {}
+    },
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.union_mode = UnionMode::tree_reduction, .cluster_disjoint = true, .shared_caps = true},
+    StlFormat::binary,
+    FacetNormals::vertex_average,
+    true,
+    {},
+    true
+  },
+  {
+    "[instrumentation]: pipelined and tiled g-code",
+    {},
+    default_cylindrical_tool,
+    default_mesh_options,
+    default_visualize,
+    default_results_directory,
+    {.analytic_lines = true, .analytic_arcs = true},
+    StlFormat::ascii,
+    FacetNormals::vertex_average,
+    false,
+    "G90 G17 G0 X0 Y0 Z0\n"
+    "G1 X1\n"
+    "G1 Y1\n"
+    "G3 X0 Y1 R0.5\n"
+    "G1 Y0\n",
+    true
+  }
 };
 
 /* 
@@ -1151,6 +1700,9 @@ const vector<CylCompoundToolpathTest> tests
 
 using Tests = vector<CylCompoundToolpathTest>;
 template <class T> static void run_tests(vector<T>& tests);
+static string read_file(const string& filepath);
+static bool is_closed(const MeshView& mesh);
+static void check_stl_reference();
 
 /* 
    ****************************************************************************
@@ -1158,6 +1710,93 @@ template <class T> static void run_tests(vector<T>& tests);
    ****************************************************************************
 */ 
 
+static string read_file(const string& filepath)
+{
+    ifstream f {filepath, ios::binary};
+    assert(f.good());
+    return string {istreambuf_iterator<char> {f}, istreambuf_iterator<char> {}};
+}
+
+/*
+    Whether a mesh has no open edges, i.e. every edge of a triangle is also an
+        edge of another triangle, run through in the opposite direction.
+*/
+static bool is_closed(const MeshView& mesh)
+{
+    // Each undirected edge counts +1 in one direction and -1 in the other.
+    map<pair<uint32_t, uint32_t>, int> balance;
+    for (size_t t {0}; t < mesh.triangle_count(); ++t)
+    {
+        for (size_t k {0}; k < 3; ++k)
+        {
+            const uint32_t a {mesh.indices[3 * t + k]};
+            const uint32_t b {mesh.indices[3 * t + (k + 1) % 3]};
+            balance[minmax(a, b)] += a < b ? 1 : -1;
+        }
+    }
+
+    for (const auto& [edge, count] : balance)
+        if (count != 0)
+            return false;
+    return true;
+}
+
+/*
+    Checks the text .stl encoding against the file that the stream based
+        writer, which it replaced, wrote for the same face. The corner normals
+        are along the axes, so that they are stored exactly.
+*/
+static void check_stl_reference()
+{
+    const string reference {
+        "solid fixed\n"
+        "    facet normal 0.577350269189626 0.577350269189626 0.577350269189626\n"
+        "        outer loop\n"
+        "            vertex 0 0 0\n"
+        "            vertex 0.1 2.5 -1.25\n"
+        "            vertex 0.333333333333333 123456.789 1e-07\n"
+        "        endloop\n"
+        "    endfacet\n"
+        "    facet normal 0.577350269189626 0.577350269189626 -0.577350269189626\n"
+        "        outer loop\n"
+        "            vertex 0.1 2.5 -1.25\n"
+        "            vertex -0.3 0.2 42\n"
+        "            vertex 0.333333333333333 123456.789 1e-07\n"
+        "        endloop\n"
+        "    endfacet\n"
+        "    facet normal -0.577350269189626 0.577350269189626 -0.577350269189626\n"
+        "        outer loop\n"
+        "            vertex 0.333333333333333 123456.789 1e-07\n"
+        "            vertex -0.3 0.2 42\n"
+        "            vertex 7 -0.000125 3.14159265358979\n"
+        "        endloop\n"
+        "    endfacet\n"
+        "endsolid fixed"
+    };
+
+    Handle(Poly_Triangulation) poly_tri {new Poly_Triangulation {5, 3, false}};
+    poly_tri->SetNode(1, gp_Pnt {0, 0, 0});
+    poly_tri->SetNode(2, gp_Pnt {.1, 2.5, -1.25});
+    poly_tri->SetNode(3, gp_Pnt {1. / 3., 123456.789, 1e-7});
+    poly_tri->SetNode(4, gp_Pnt {-.3, .2, 42});
+    poly_tri->SetNode(5, gp_Pnt {7, -.000125, 3.14159265358979});
+    poly_tri->SetTriangle(1, Poly_Triangle {1, 2, 3});
+    poly_tri->SetTriangle(2, Poly_Triangle {2, 4, 3});
+    poly_tri->SetTriangle(3, Poly_Triangle {3, 4, 5});
+    poly_tri->AddNormals();
+    poly_tri->SetNormal(1, gp_Dir {0, 0, 1});
+    poly_tri->SetNormal(2, gp_Dir {1, 0, 0});
+    poly_tri->SetNormal(3, gp_Dir {0, 1, 0});
+    poly_tri->SetNormal(4, gp_Dir {0, 0, -1});
+    poly_tri->SetNormal(5, gp_Dir {-1, 0, 0});
+
+    string text {stl_header("fixed", StlFormat::ascii)};
+    append_stl_facets(text, FaceTriangulation {poly_tri, false, 0}, StlFormat::ascii, FacetNormals::vertex_average);
+    text += stl_trailer("fixed", StlFormat::ascii);
+    assert(text == reference);
+    cout << "Text .stl encoding matches the reference" << endl;
+}
+
 template <class T>
 static void run_tests(const vector<T>& tests)
 { 
@@ -1166,18 +1805,170 @@ static void run_tests(const vector<T>& tests)
         cout << endl;
         cout << "********* TEST: " << test.name << " **********" << endl;
 
+        Instrumentation instrumentation;
+        BuildOptions options {test.options};
+        if (test.instrumented)
+            options.instrumentation = &instrumentation;
+
+        SegmentCompound path {test.path};
+        SegmentList program;
+        if (!test.gcode.empty())
+        {
+            const string gcode_path {test.results_directory.string() + test.name + ".ngc"};
+            ofstream gcode_file {gcode_path};
+            gcode_file << test.gcode;
+            gcode_file.close();
+            const SegmentCompound parsed {read_gcode_file(gcode_path)};
+            cout << "Read toolpath from: " << gcode_path << endl;
+
+            // Build from the binary form of the program, which must hold the
+            //     same segments.
+            const string segments_path {test.results_directory.string() + test.name + ".segments"};
+            SegmentFile::convert_gcode(gcode_path, segments_path);
+            const SegmentFile segment_file {segments_path};
+            path = segment_file.segments();
+            assert(segment_file.version() == SEGMENT_FILE_VERSION);
+            assert(get<0>(path).size() == get<0>(parsed).size() and get<1>(path).size() == get<1>(parsed).size() and
+                   get<2>(path).size() == get<2>(parsed).size() and get<3>(path).size() == get<3>(parsed).size());
+            cout << "Converted toolpath to: " << segments_path << endl;
+
+            // Build in program order.
+            program = segment_file.segment_list();
+            assert(program.size() == segment_file.segment_count());
+        }
+
         cout << "Starting to build toolpath for test " << test.name << endl;
-        ToolPath tool_path {test.path, test.tool, test.visualize};
+        ToolPath tool_path {program.empty() ? ToolPath {path, test.tool, test.visualize, options}
+                                            : ToolPath {program, test.tool, test.visualize, options}};
         cout << "Finished B-Rep construction for test " << test.name << endl;
+        if (test.options.arc_fitting_tolerance > 0)
+            cout << "Arc fitting deviated by at most " << tool_path.approximation_error() << endl;
         
         cout << "Starting to mesh surface for test " << test.name << endl;
-        tool_path.mesh_surface(test.meshing_parameters.first, test.meshing_parameters.second);
+        tool_path.mesh_surface(test.meshing_parameters.first, test.meshing_parameters.second,
+                               test.facet_normals == FacetNormals::vertex_average);
         cout << "Finished meshing surface for test " << test.name << endl;
         
-        string stl_path = test.results_directory.string() + test.name + ".stl";
-        tool_path.shape_to_stl(test.name, stl_path);
+        if (test.compared_threads > 0)
+        {
+            // The per-segment solids are built concurrently but fused in the
+            //     same order, so the number of workers must not show.
+            for (const unsigned int threads : {1u, test.compared_threads})
+            {
+                BuildOptions threaded_options {options};
+                threaded_options.threads = threads;
+                threaded_options.output_compression = Compression::none;
+                ToolPath threaded {program.empty() ? ToolPath {path, test.tool, false, threaded_options}
+                                                   : ToolPath {program, test.tool, false, threaded_options}};
+                threaded.mesh_surface(test.meshing_parameters.first, test.meshing_parameters.second);
+                const string threaded_path {test.results_directory.string() + test.name + ".threads" + to_string(threads)};
+                threaded.shape_to_stl(test.name, threaded_path + ".stl", StlFormat::binary, test.facet_normals);
+                threaded.shape_to_stl(test.name, threaded_path + ".ascii.stl", StlFormat::ascii, test.facet_normals);
+            }
+            const string single_path {test.results_directory.string() + test.name + ".threads1"};
+            const string multiple_path {test.results_directory.string() + test.name + ".threads" + to_string(test.compared_threads)};
+            assert(read_file(single_path + ".stl") == read_file(multiple_path + ".stl"));
+            assert(read_file(single_path + ".ascii.stl") == read_file(multiple_path + ".ascii.stl"));
+            cout << "Built and written the same on 1 and " << test.compared_threads << " workers" << endl;
+        }
+
+        const string suffix {test.options.output_compression == Compression::gzip ? ".gz" : ""};
+        string stl_path = test.results_directory.string() + test.name + ".stl" + suffix;
+        tool_path.shape_to_stl(test.name, stl_path, test.stl_format, test.facet_normals);
         cout << "Surface mesh written to: " << stl_path << endl;
 
+        if (!test.gcode.empty())
+        {
+            // Again with every stage running at once. Small batches make even
+            //     a short program go through several of them.
+            const string gcode_path {test.results_directory.string() + test.name + ".ngc"};
+            const string pipelined_path {test.results_directory.string() + test.name + ".pipelined.stl" + suffix};
+            const ToolPath pipelined {ToolPath::pipeline(gcode_path, test.tool,
+                                                         test.meshing_parameters.first, test.meshing_parameters.second,
+                                                         test.name, pipelined_path, test.stl_format, FacetNormals::geometric,
+                                                         options, PipelineOptions {.batch_segments = 2})};
+            assert(pipelined.mesh_view().triangle_count() > 0);
+            cout << "Pipelined surface mesh written to: " << pipelined_path << endl;
+
+            // The pipeline wrote geometric normals, but the toolpath it returns
+            //     must still have the vertex normals shape_to_stl() averages.
+            const string reexported_path {test.results_directory.string() + test.name + ".reexported.stl" + suffix};
+            pipelined.shape_to_stl(test.name, reexported_path);
+            if (suffix.empty())
+            {
+                pipelined.shape_to_stl(test.name, reexported_path, test.stl_format, FacetNormals::geometric);
+                assert(read_file(reexported_path) == read_file(pipelined_path));
+            }
+            cout << "Pipelined toolpath written again to: " << reexported_path << endl;
+
+            // With the whole program in one batch, the solids are fused as the
+            //     constructor fuses them, so the file must be the same.
+            if (suffix.empty() and !options.cluster_disjoint)
+            {
+                const string single_batch_path {test.results_directory.string() + test.name + ".single_batch.stl"};
+                ToolPath::pipeline(gcode_path, test.tool, test.meshing_parameters.first, test.meshing_parameters.second,
+                                   test.name, single_batch_path, test.stl_format, test.facet_normals,
+                                   options, PipelineOptions {.batch_segments = program.size()});
+                assert(read_file(single_batch_path) == read_file(stl_path));
+                cout << "Single batch pipelined mesh matches: " << single_batch_path << endl;
+            }
+
+            // And tile by tile, stitched back together and one file per tile.
+            TiledToolPath tiled {program, test.tool, TileGrid {}, options};
+            tiled.mesh_surface(test.meshing_parameters.first, test.meshing_parameters.second,
+                               test.facet_normals == FacetNormals::vertex_average);
+            assert(tiled.tile_count() > 0 and tiled.mesh_view().triangle_count() > 0);
+            assert(is_closed(tiled.mesh_view()));
+            const string tiled_path {test.results_directory.string() + test.name + ".tiled.ply" + suffix};
+            tiled.shape_to_ply(tiled_path);
+            for (size_t i {0}; i < tiled.tile_count(); ++i)
+            {
+                const string tile_name {test.name + ".tile" + to_string(i)};
+                tiled.tile(i).shape_to_stl(tile_name, test.results_directory.string() + tile_name + ".stl" + suffix,
+                                           test.stl_format, test.facet_normals);
+            }
+            cout << "Tiled mesh of " << tiled.tile_count() << " tiles written to: " << tiled_path << endl;
+        }
+
+        if (test.indexed_export)
+        {
+            string ply_path = test.results_directory.string() + test.name + ".ply" + suffix;
+            string obj_path = test.results_directory.string() + test.name + ".obj" + suffix;
+            string glb_path = test.results_directory.string() + test.name + ".glb" + suffix;
+            tool_path.shape_to_ply(ply_path);
+            tool_path.shape_to_obj(obj_path);
+            tool_path.shape_to_glb(glb_path);
+            cout << "Indexed meshes written to: " << ply_path << ", " << obj_path << " and " << glb_path << endl;
+
+            const MeshView mesh {tool_path.mesh_view()};
+            for (const uint32_t index : mesh.indices)
+                assert(index < mesh.vertex_count());
+            assert(mesh.normals.size() == mesh.positions.size());
+            assert(3 * mesh.triangle_count() == mesh.indices.size());
+            cout << "Mesh view has " << mesh.vertex_count() << " vertices and " << mesh.triangle_count() << " triangles" << endl;
+
+            size_t streamed {0};
+            uint32_t last_face_id {0};
+            for (const Triangle& triangle : tool_path.triangles())
+            {
+                assert(triangle.face_id >= last_face_id);
+                last_face_id = triangle.face_id;
+                ++streamed;
+            }
+            size_t batched {0};
+            tool_path.for_each_triangle_batch(1000, [&batched](span<const Triangle> batch) { batched += batch.size(); });
+            assert(streamed == batched and streamed >= mesh.triangle_count());
+            cout << "Streamed " << streamed << " triangles" << endl;
+        }
+
+        if (test.instrumented)
+        {
+            string trace_path = test.results_directory.string() + test.name + ".trace.json";
+            instrumentation.write_chrome_trace(trace_path);
+            cout << instrumentation.summary();
+            cout << "Trace written to: " << trace_path << endl;
+        }
+
         cout << "SUCCESS: The test " << test.name << " succeeded!" << endl;
 
         cout << "********* FINISH TEST: " << test.name << " **********" << endl;
@@ -1186,6 +1977,7 @@ static void run_tests(const vector<T>& tests)
 
 int main()
 {
+    check_stl_reference();
     run_tests(tests);
     return EXIT_SUCCESS;
 }